@@ -9,18 +9,63 @@
 #include <algorithm>
 #include <utility>
 #include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "../common/history.h"
+#include "../common/checkpoint.h"
+#include "../common/tick_scheduler.h"
 
 #include "../common/agent.h"
 #include "../common/messages.h"
+#include "../common/price.h"
+#include "../common/thread_pool.h"
+#include "order_book.h"
 #include "../traders/inventory.h"
 #include "../common/commodity.h"
 
 #include "../metrics/logger.h"
+#include "../metrics/latency.h"
+#include "../metrics/trace.h"
 
 #include <thread>
 
+// Always-on phase timings for the auction house, readable at runtime from any thread
+struct AuctionHouseTimings {
+    LatencyHistogram tick{"AH Tick"};
+    LatencyHistogram flush_inbox{"AH FlushInbox"};
+    LatencyHistogram flush_outbox{"AH FlushOutbox"};
+    LatencyHistogram resolve_intake{"ResolveOffers intake"};
+    LatencyHistogram resolve_validate{"ResolveOffers validate"};
+    LatencyHistogram resolve_match{"ResolveOffers match"};
+    LatencyHistogram resolve_history{"ResolveOffers history"};
+
+    std::string Summary() const {
+        std::string output;
+        for (auto* histogram : {&tick, &flush_inbox, &flush_outbox, &resolve_intake, &resolve_validate, &resolve_match, &resolve_history}) {
+            output.append(histogram->Summary()).append("\n");
+        }
+        return output;
+    }
+
+    void Reset() {
+        for (auto* histogram : {&tick, &flush_inbox, &flush_outbox, &resolve_intake, &resolve_validate, &resolve_match, &resolve_history}) {
+            histogram->Reset();
+        }
+    }
+};
+
+// Monotonic event counts, readable at runtime from any thread
+struct AuctionHouseCounters {
+    std::atomic<std::uint64_t> ticks{0};
+    std::atomic<std::uint64_t> overruns{0};            // ticks that took longer than the tick time
+    std::atomic<std::uint64_t> ticks_skipped{0};       // fell due during an overrun and were dropped (see TickSchedule)
+    std::atomic<std::uint64_t> messages_received{0};
+    std::atomic<std::uint64_t> messages_sent{0};
+    std::atomic<std::uint64_t> messages_refused{0};     // turned away by TryReceiveMessage with the inbox full
+};
+
 class AuctionHouse : public Agent {
 public:
     History history;
@@ -29,59 +74,123 @@ public:
     std::string unique_name;
 private:
     // debug info
-    int num_deaths;
-    int total_age;
+    int num_deaths = 0;
+    int total_age = 0;
 
-    int TICK_TIME_MS = 10; //ms
+    TickSchedule tick_schedule;                             // see SetTickSchedule
+    std::atomic<std::int64_t> tick_interval_ns{10*1000000}; // current interval, which may be adapting
     std::atomic<bool> queue_active = true;
     std::thread message_thread;
 
-    std::mutex bid_book_mutex;
-    std::mutex ask_book_mutex;
-//    std::mutex known_traders_mutex;
+    // Lock order: books_mutex, known_traders_mutex, then an OrderBook's match_mutex, then its intake_mutex or
+    // Trader settlement mutexes
+    mutable std::shared_mutex books_mutex;          // guards the set of commodities/books, not the books' contents
+    mutable std::shared_mutex known_traders_mutex;  // shared while resolving or sending, unique to (de)register
+    // Registrations and shutdown notices are staged here by the message thread, which only applies them when it can
+    // take known_traders_mutex without waiting. Any it couldn't are applied at the start of the next tick, before
+    // matching takes the registry, so a trader joining or dying never holds up the inbox for a matching pass.
+    std::mutex registry_intake_mutex;
+    std::vector<Message> registry_intake;
+    std::vector<Message> registry_applying;         // swapped with registry_intake, to reuse both buffers' capacity
+    std::atomic<bool> registry_changes_pending = false;
+    std::mutex spread_profit_mutex;
+    std::atomic<std::uint64_t> next_order_id{1};
 
-    int MAX_PROCESSED_MESSAGES_PER_FLUSH = 800;
-    double SALES_TAX = 0.08;
-    double BROKER_FEE = 0.03;
+    // Flow control: order flow is refused once the inbox holds INBOX_LIMIT messages (see TryReceiveMessage), and
+    // each flush runs for a time budget rather than a message count (see FlushBudgetNs)
+    std::size_t INBOX_LIMIT = 1 << 14;
+    std::int64_t MIN_FLUSH_BUDGET_NS = 200*1000;
+    int FLUSH_CLOCK_INTERVAL = 16;                  // messages between deadline checks
+    std::atomic<std::int64_t> next_tick_ns{0};      // when Tick() next resolves; 0 while it isn't running
+    std::int64_t SALES_TAX_BPS = 800;   // basis points of the sale value, paid by the seller
+    std::int64_t BROKER_FEE_BPS = 300;  // basis points of an offer's notional value, paid once per order
     int ticks = 0;
 //    std::mt19937 rng_gen = std::mt19937(std::random_device()());
     std::map<std::string, Commodity> known_commodities;
-    std::map<int, std::shared_ptr<Trader>> known_traders;  //key = trader-id
+    std::unordered_map<int, std::shared_ptr<Trader>> known_traders;  //key = trader-id
     std::map<std::string, int> demographics = {};
 
-    std::map<std::string, std::vector<std::pair<BidOffer, BidResult>>> bid_book = {};
-    std::map<std::string, std::vector<std::pair<AskOffer, AskResult>>> ask_book = {};
+    std::map<std::string, std::unique_ptr<OrderBook>> books = {};
+    std::vector<std::string> commodity_names = {};  // indexable copy of known_commodities' keys for the worker pool
     FileLogger logger;
+    WorkerPool resolve_pool;
 
 public:
-    double spread_profit = 0;
-    AuctionHouse(int auction_house_id, Log::LogLevel verbosity)
+    Price spread_profit;
+    AuctionHouseTimings timings;
+    AuctionHouseCounters counters;
+
+    // num_resolve_workers: extra threads used to resolve commodities in parallel (the tick thread also takes part).
+    // Defaults to one per remaining core.
+    AuctionHouse(int auction_house_id, Log::LogLevel verbosity, int num_resolve_workers = -1)
         : Agent(auction_house_id)
         , unique_name(std::string("AH")+std::to_string(id))
-        , logger(FileLogger(verbosity, unique_name)) {
+        , logger(FileLogger(verbosity, unique_name))
+        , resolve_pool((num_resolve_workers < 0) ? DefaultResolveWorkers() : num_resolve_workers, unique_name + " resolve") {
         message_thread = std::thread([this] { MessageLoop(); });
     }
 
+    static int DefaultResolveWorkers() {
+        return std::max(0, (int) std::thread::hardware_concurrency() - 1);
+    }
+
     ~AuctionHouse() override {
         logger.Log(Log::DEBUG, "Destroying auction house");
         ShutdownMessageThread();
+        logger.Log(Log::INFO, "Phase timings:\n" + timings.Summary());
         known_traders.clear();
     }
     int GetNumTraders() const {
+        std::shared_lock<std::shared_mutex> lock(known_traders_mutex);
         return (int) known_traders.size();
     }
 
+    // False once a trader's shutdown notice has been processed, after which nothing more will be sent to it
+    bool IsRegistered(int trader_id) const {
+        std::shared_lock<std::shared_mutex> lock(known_traders_mutex);
+        return known_traders.find(trader_id) != known_traders.end();
+    }
+
     std::pair<double, std::map<std::string, int>> GetDemographics() const {
+        std::shared_lock<std::shared_mutex> lock(known_traders_mutex);
         return {(num_deaths > 0) ? total_age / num_deaths : 0, demographics};
     }
 
+    // Bounded counterpart of ReceiveMessage, for order flow. Once the inbox holds INBOX_LIMIT messages the message is
+    // refused and left with the caller, who should hold on to it (or drop it) and ease off (see Load).
+    bool TryReceiveMessage(Message& incoming_message) {
+        if (inbox.try_push(incoming_message, INBOX_LIMIT)) {
+            return true;
+        }
+        counters.messages_refused.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // How full the inbox is, from 0 (empty) to 1 (refusing order flow). Advertised so senders can back off early.
+    double Load() const {
+        return std::min(1.0, (double) inbox.size() / (double) INBOX_LIMIT);
+    }
+
+    // How long a flush may run: half the time left before Tick() next resolves, so booking orders and delivering
+    // results take turns at least twice a tick however deep the queues get. Never less than MIN_FLUSH_BUDGET_NS, so an
+    // overrunning AH still makes progress, and a whole tick when nothing is ticking us.
+    std::int64_t FlushBudgetNs() const {
+        std::int64_t tick_ns = tick_interval_ns.load(std::memory_order_relaxed);
+        auto next_tick = next_tick_ns.load(std::memory_order_relaxed);
+        if (next_tick == 0) {
+            return tick_ns;
+        }
+        return std::clamp((next_tick - monotonic_ns())/2, MIN_FLUSH_BUDGET_NS, std::max(MIN_FLUSH_BUDGET_NS, tick_ns/2));
+    }
+
     void MessageLoop() {
+        TraceRecorder::Global().NameThread(unique_name + " messages");
         while (true) {
             if (!queue_active) {
                 return;
             }
-            FlushInbox();
-            FlushOutbox();
+            FlushInbox(FlushBudgetNs());
+            FlushOutbox(FlushBudgetNs());
             std::this_thread::sleep_for(std::chrono::milliseconds{1});
         }
     }
@@ -98,8 +207,10 @@ public:
         logger.Log(Log::INFO, "Message thread shutdown");
         // Now message thread is gone we can safely send shutdown commands via the main thread
         auto shutdown_command = Message(id).AddShutdownCommand({id});
+        ApplyRegistryChanges();
+        std::shared_lock<std::shared_mutex> lock(known_traders_mutex);
         for (auto& recipient : known_traders) {
-            known_traders[recipient.first]->ReceiveMessage(*shutdown_command);
+            recipient.second->ReceiveMessage(*shutdown_command);
         }
     }
 
@@ -109,36 +220,81 @@ public:
         recipient->ReceiveMessage(std::move(outgoing_message));
     }
     void FlushOutbox() {
+        FlushOutbox(FlushBudgetNs());
+    }
+    void FlushOutbox(std::int64_t budget_ns) {
+        ScopedLatency timer(timings.flush_outbox);
+        TraceSpan span("AH FlushOutbox");
         logger.Log(Log::DEBUG, "Flushing outbox");
-        auto outgoing = outbox.pop();
+        std::shared_lock<std::shared_mutex> traders_lock(known_traders_mutex);
+        std::int64_t deadline_ns = monotonic_ns() + budget_ns;
         int num_processed = 0;
-        while (outgoing && num_processed < MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-            if (known_traders.find(outgoing->first) == known_traders.end()) {
-                logger.Log(Log::DEBUG, "Failed to send message, unknown recipient " + std::to_string(outgoing->first));
+        bool out_of_time = false;
+        while (true) {
+            if (num_processed > 0 && num_processed % FLUSH_CLOCK_INTERVAL == 0 && monotonic_ns() >= deadline_ns) {
+                out_of_time = true;
+                break;
+            }
+            auto outgoing = outbox.pop();
+            if (!outgoing) {
+                break;
+            }
+            auto* recipient = FindTrader(outgoing->first);
+            if (!recipient) {
+                if (logger.Enabled(Log::DEBUG)) {
+                    logger.Log(Log::DEBUG, "Failed to send message, unknown recipient " + std::to_string(outgoing->first));
+                }
             } else {
-                logger.LogSent(outgoing->first, Log::DEBUG, outgoing->second.ToString());
-                known_traders[outgoing->first]->ReceiveMessage(std::move(outgoing->second));
+                if (logger.Enabled(Log::DEBUG)) {
+                    logger.LogSent(outgoing->first, Log::DEBUG, outgoing->second.ToString());
+                }
+                recipient->ReceiveMessage(std::move(outgoing->second));
             }
             num_processed++;
-            outgoing = outbox.pop();
         }
-        if (num_processed == MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-            logger.Log(Log::WARN, "Outbox not fully flushed (tick "+std::to_string(ticks)+", " + std::to_string(inbox.size())+ " remaining)");
+        if (out_of_time && logger.Enabled(Log::WARN)) {
+            logger.Log(Log::WARN, "Outbox not fully flushed (tick "+std::to_string(ticks)+", " + std::to_string(outbox.size())+ " remaining)");
+        }
+        if (num_processed == 0) {
+            span.Discard();
+        }
+        counters.messages_sent.fetch_add(num_processed, std::memory_order_relaxed);
+        if (logger.Enabled(Log::DEBUG)) {
+            logger.Log(Log::DEBUG, "Flush finished (sent " + std::to_string(num_processed)+")");
         }
-        logger.Log(Log::DEBUG, "Flush finished (sent " + std::to_string(num_processed)+")");
     }
     void FlushInbox() {
+        FlushInbox(FlushBudgetNs());
+    }
+    void FlushInbox(std::int64_t budget_ns) {
+        ScopedLatency timer(timings.flush_inbox);
+        TraceSpan span("AH FlushInbox");
         logger.Log(Log::DEBUG, "Flushing inbox");
-        auto incoming_message = inbox.pop();
+        std::int64_t deadline_ns = monotonic_ns() + budget_ns;
         int num_processed = 0;
-        while (incoming_message && num_processed < MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-            logger.LogReceived(incoming_message->sender_id, Log::DEBUG, incoming_message->ToString());
+        bool out_of_time = false;
+        while (true) {
+            if (num_processed > 0 && num_processed % FLUSH_CLOCK_INTERVAL == 0 && monotonic_ns() >= deadline_ns) {
+                out_of_time = true;
+                break;
+            }
+            auto incoming_message = inbox.pop();
+            if (!incoming_message) {
+                break;
+            }
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.LogReceived(incoming_message->sender_id, Log::DEBUG, incoming_message->ToString());
+            }
             if (incoming_message->GetType() == Msg::EMPTY) {
                 //no-op
             } else if (incoming_message->GetType() == Msg::BID_OFFER) {
                 ProcessBid(*incoming_message);
             } else if (incoming_message->GetType() == Msg::ASK_OFFER) {
                 ProcessAsk(*incoming_message);
+            } else if (incoming_message->GetType() == Msg::CANCEL_ORDER) {
+                ProcessCancel(*incoming_message);
+            } else if (incoming_message->GetType() == Msg::AMEND_ORDER) {
+                ProcessAmend(*incoming_message);
             } else if (incoming_message->GetType() == Msg::REGISTER_REQUEST) {
                 ProcessRegistrationRequest(*incoming_message);
             } else if (incoming_message->GetType() == Msg::SHUTDOWN_NOTIFY){
@@ -147,12 +303,20 @@ public:
                 logger.Log(Log::ERROR, "Unknown/unsupported message type");
             }
             num_processed++;
-            incoming_message = inbox.pop();
         }
-        if (num_processed == MAX_PROCESSED_MESSAGES_PER_FLUSH) {
+        if (registry_changes_pending) {
+            TryApplyRegistryChanges();
+        }
+        if (out_of_time && logger.Enabled(Log::WARN)) {
             logger.Log(Log::WARN, "Inbox not fully flushed (tick "+std::to_string(ticks)+", " + std::to_string(inbox.size())+ " remaining)");
         }
-        logger.Log(Log::DEBUG, "Flush finished (received " + std::to_string(num_processed)+")");
+        if (num_processed == 0) {
+            span.Discard();
+        }
+        counters.messages_received.fetch_add(num_processed, std::memory_order_relaxed);
+        if (logger.Enabled(Log::DEBUG)) {
+            logger.Log(Log::DEBUG, "Flush finished (received " + std::to_string(num_processed)+")");
+        }
     }
 
     // Message processing
@@ -162,9 +326,24 @@ public:
             logger.Log(Log::ERROR, "Malformed bid_offer message");
             return; //drop
         }
-        bid_book_mutex.lock();
-        bid_book[bid->commodity].push_back({*bid, {id, bid->commodity, bid->unit_price} });
-        bid_book_mutex.unlock();
+        {
+            std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+            auto book = books.find(bid->commodity);
+            if (book == books.end()) {
+                logger.Log(Log::WARN, "Refused bid for unknown commodity " + bid->commodity);
+                // so the trader stops waiting for an order id
+                SendMessage(*Message(id).AddOrderAck(OrderAck(id, 0, bid->commodity, true, true)), bid->sender_id);
+                return;
+            }
+            BidResult result(id, bid->commodity, bid->unit_price.ToDouble());
+            result.timestamps = bid->timestamps;
+            result.timestamps.booked_ns = monotonic_ns();
+            bid->order_id = next_order_id.fetch_add(1, std::memory_order_relaxed);
+            result.order_id = bid->order_id;
+            // ack before the book can see the order, so the trader never gets a result for an id it doesn't know yet
+            SendMessage(*Message(id).AddOrderAck(OrderAck(id, bid->order_id, bid->commodity, true)), bid->sender_id);
+            book->second->AddBid(*bid, std::move(result));
+        }
     }
     void ProcessAsk(Message& message) {
         auto ask = message.ask_offer;
@@ -172,16 +351,112 @@ public:
             logger.Log(Log::ERROR, "Malformed ask_offer message");
             return; //drop
         }
-        ask_book_mutex.lock();
-        ask_book[ask->commodity].push_back({*ask, {id, ask->commodity} });
-        ask_book_mutex.unlock();
+        {
+            std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+            auto book = books.find(ask->commodity);
+            if (book == books.end()) {
+                logger.Log(Log::WARN, "Refused ask for unknown commodity " + ask->commodity);
+                // so the trader stops waiting for an order id
+                SendMessage(*Message(id).AddOrderAck(OrderAck(id, 0, ask->commodity, false, true)), ask->sender_id);
+                return;
+            }
+            AskResult result(id, ask->commodity);
+            result.timestamps = ask->timestamps;
+            result.timestamps.booked_ns = monotonic_ns();
+            ask->order_id = next_order_id.fetch_add(1, std::memory_order_relaxed);
+            result.order_id = ask->order_id;
+            // ack before the book can see the order, so the trader never gets a result for an id it doesn't know yet
+            SendMessage(*Message(id).AddOrderAck(OrderAck(id, ask->order_id, ask->commodity, false)), ask->sender_id);
+            book->second->AddAsk(*ask, std::move(result));
+        }
+    }
+    void ProcessCancel(Message& message) {
+        auto cancel = message.cancel_order;
+        if (!cancel) {
+            logger.Log(Log::ERROR, "Malformed cancel_order message");
+            return; //drop
+        }
+        std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+        auto book = books.find(cancel->commodity);
+        if (book == books.end()) {
+            logger.Log(Log::WARN, "Dropped cancel for unknown commodity " + cancel->commodity);
+            return;
+        }
+        book->second->AddCancel(std::move(*cancel));
+    }
+    void ProcessAmend(Message& message) {
+        auto amend = message.amend_order;
+        if (!amend) {
+            logger.Log(Log::ERROR, "Malformed amend_order message");
+            return; //drop
+        }
+        std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+        auto book = books.find(amend->commodity);
+        if (book == books.end()) {
+            logger.Log(Log::WARN, "Dropped amend for unknown commodity " + amend->commodity);
+            return;
+        }
+        book->second->AddAmend(std::move(*amend));
     }
+    // Takes effect straight away unless a tick is matching (see registry_intake)
     void ProcessRegistrationRequest(Message& message) {
-        auto request = message.register_request;
-        if (!request) {
+        if (!message.register_request) {
             logger.Log(Log::ERROR, "Malformed register_request message");
             return; //drop
         }
+        StageRegistryChange(message);
+    }
+    void ProcessShutdownNotify(Message& message) {
+        if (!message.shutdown_notify) {
+            logger.Log(Log::ERROR, "Malformed shutdown_notify message");
+            return; //drop
+        }
+        StageRegistryChange(message);
+    }
+
+    // Applies any staged registry changes, waiting for the registry if need be
+    void ApplyRegistryChanges() {
+        if (!registry_changes_pending) {
+            return;
+        }
+        std::unique_lock<std::shared_mutex> traders_lock(known_traders_mutex);
+        ApplyStagedRegistryChanges();
+    }
+private:
+    void StageRegistryChange(Message& message) {
+        {
+            std::lock_guard<std::mutex> lock(registry_intake_mutex);
+            registry_intake.push_back(std::move(message));
+            registry_changes_pending = true;
+        }
+        TryApplyRegistryChanges();
+    }
+    // Applies staged registry changes unless the registry is busy (eg a tick is matching), in which case they wait
+    void TryApplyRegistryChanges() {
+        std::unique_lock<std::shared_mutex> traders_lock(known_traders_mutex, std::try_to_lock);
+        if (traders_lock.owns_lock()) {
+            ApplyStagedRegistryChanges();
+        }
+    }
+    // Requires known_traders_mutex (unique). Changes are applied in the order they arrived.
+    void ApplyStagedRegistryChanges() {
+        {
+            std::lock_guard<std::mutex> lock(registry_intake_mutex);
+            registry_applying.swap(registry_intake);
+            registry_changes_pending = false;
+        }
+        for (auto& message : registry_applying) {
+            if (message.GetType() == Msg::REGISTER_REQUEST) {
+                ApplyRegistrationRequest(message);
+            } else {
+                ApplyShutdownNotify(message);
+            }
+        }
+        registry_applying.clear();
+    }
+    // Requires known_traders_mutex (unique)
+    void ApplyRegistrationRequest(Message& message) {
+        auto request = message.register_request;
         // check no id clash
         auto requested_id = message.sender_id;
         if (requested_id == id) {
@@ -217,7 +492,8 @@ public:
         msg.AddRegisterResponse(RegisterResponse(id, true));
         SendMessage(msg, requested_id);
     }
-    void ProcessShutdownNotify(Message& message) {
+    // Requires known_traders_mutex (unique)
+    void ApplyShutdownNotify(Message& message) {
         demographics[message.shutdown_notify->class_name] -= 1;
         num_deaths += 1;
         total_age += message.shutdown_notify->age_at_death;
@@ -225,6 +501,37 @@ public:
         known_traders.erase(message.sender_id);
     }
 
+public:
+    // Registers a whole cohort in one go, under the same rules as a RegisterRequest: the registry is grown once, and
+    // each response goes straight to the trader rather than through our outbox. For bringing up large populations,
+    // where a request per trader would flood the inbox. Returns the number accepted.
+    // Callers that learn the outcome from the return value can skip the responses, which saves a Message in every
+    // trader's inbox.
+    template <typename T>
+    int RegisterTraders(const std::vector<std::shared_ptr<T>>& traders, bool send_responses = true) {
+        std::unique_lock<std::shared_mutex> traders_lock(known_traders_mutex);
+        known_traders.reserve(known_traders.size() + traders.size());
+        int num_accepted = 0;
+        for (auto& trader : traders) {
+            std::optional<std::string> rejection;
+            if (trader->id == id) {
+                rejection = "ID clash with auction house";
+            } else if (!known_traders.emplace(trader->id, trader).second) {
+                rejection = "ID clash with existing trader";
+            } else {
+                demographics[trader->class_name] += 1;
+                num_accepted++;
+            }
+            if (send_responses) {
+                auto msg = Message(id);
+                msg.AddRegisterResponse(RegisterResponse(id, !rejection, std::move(rejection)));
+                trader->ReceiveMessage(std::move(msg));
+            }
+        }
+        logger.Log(Log::INFO, "Registered " + std::to_string(num_accepted) + "/" + std::to_string(traders.size()) + " traders in bulk");
+        return num_accepted;
+    }
+
     double t_PercentPriceChange(const std::string& commodity, int window) const {
         return history.prices.t_percentage_change(commodity, 1000);
     }
@@ -287,81 +594,308 @@ public:
         return history.net_supply.t_average(commodity, window);
     }
     int NumKnownTraders() const {
+        std::shared_lock<std::shared_mutex> lock(known_traders_mutex);
         return (int) known_traders.size();
     }
     void RegisterCommodity(const Commodity& new_commodity) {
+        std::unique_lock<std::shared_mutex> lock(books_mutex);
         if (known_commodities.find(new_commodity.name) != known_commodities.end()) {
             //already exists
             return;
         }
         history.initialise(new_commodity.name);
         known_commodities[new_commodity.name] = new_commodity;
+        books[new_commodity.name] = std::make_unique<OrderBook>();
+        commodity_names.push_back(new_commodity.name);
+    }
 
-        bid_book_mutex.lock();
-        bid_book[new_commodity.name] = {};
-        bid_book_mutex.unlock();
+    // CHECKPOINTS
+    // Writes the ledger, history and every resting order whose id is in keep_orders (so that only orders some saved
+    // trader knows about come back). The trader registry isn't saved: traders are saved alongside and registered again
+    // on restore. Requires the auction house to be stopped; anything still in the inbox or intake is left out.
+    void Save(CheckpointWriter& out, const std::unordered_set<std::uint64_t>& keep_orders) const {
+        std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+        out.Section(Checkpoint::AUCTION_HOUSE);
+        out.Write((std::uint32_t) commodity_names.size());
+        for (auto& name : commodity_names) {
+            out.WriteString(name);
+        }
+        out.Write(ticks);
+        out.Write(next_order_id.load());
+        out.Write(spread_profit.ticks);
+        out.Write(num_deaths);
+        out.Write(total_age);
+        history.Save(out);
 
-        ask_book_mutex.lock();
-        ask_book[new_commodity.name] = {};
-        ask_book_mutex.unlock();
+        out.Section(Checkpoint::BOOKS);
+        for (auto& name : commodity_names) {
+            auto& book = *books.at(name);
+            std::lock_guard<std::mutex> match_lock(book.match_mutex);
+            std::uint32_t num_bids = 0;
+            std::uint32_t num_asks = 0;
+            for (auto& level : book.bids) {
+                num_bids += keep_orders.count(level.second.first.order_id);
+            }
+            for (auto& level : book.asks) {
+                num_asks += keep_orders.count(level.second.first.order_id);
+            }
+            // in priority order, so restoring them in order keeps time priority within a price
+            out.Write(num_bids);
+            for (auto& [price, entry] : book.bids) {
+                auto& [offer, result] = entry;
+                if (keep_orders.count(offer.order_id) > 0) {
+                    out.Write(offer.expiry_ms);
+                    out.Write(offer.order_id);
+                    out.Write(offer.sender_id);
+                    out.Write(offer.quantity);
+                    out.Write(offer.unit_price.ticks);
+                    out.Write(result.broker_fee_paid);
+                    out.Write(result.quantity_untraded);
+                    out.Write(result.quantity_traded);
+                    out.Write(result.bought_price);
+                    out.Write(result.original_price);
+                }
+            }
+            out.Write(num_asks);
+            for (auto& [price, entry] : book.asks) {
+                auto& [offer, result] = entry;
+                if (keep_orders.count(offer.order_id) > 0) {
+                    out.Write(offer.expiry_ms);
+                    out.Write(offer.order_id);
+                    out.Write(offer.sender_id);
+                    out.Write(offer.quantity);
+                    out.Write(offer.unit_price.ticks);
+                    out.Write(result.broker_fee_paid);
+                    out.Write(result.quantity_untraded);
+                    out.Write(result.quantity_traded);
+                    out.Write(result.avg_price);
+                }
+            }
+        }
     }
 
+    // Restores what Save wrote. Every saved commodity must already be registered, and the auction house must not be
+    // ticking yet. Restored orders go into the books' intake and rejoin the books on the first resolution, with
+    // expiries (like history timestamps) moved on by time_offset_ms. Order timestamps start from zero, so restored
+    // orders are left out of the latency stats.
+    bool Restore(CheckpointReader& in, std::int64_t time_offset_ms) {
+        std::unique_lock<std::shared_mutex> books_lock(books_mutex);
+        if (!in.Section(Checkpoint::AUCTION_HOUSE, "auction house")) {
+            return false;
+        }
+        std::vector<std::string> names(in.Read<std::uint32_t>());
+        for (auto& name : names) {
+            name = in.ReadString();
+            if (in.ok() && books.count(name) == 0) {
+                return in.Fail("unknown commodity " + name);
+            }
+        }
+        ticks = in.Read<int>();
+        auto saved_next_order_id = in.Read<std::uint64_t>();
+        if (saved_next_order_id > next_order_id.load()) {
+            next_order_id = saved_next_order_id;
+        }
+        spread_profit.ticks = in.Read<std::int64_t>();
+        num_deaths = in.Read<int>();
+        total_age = in.Read<int>();
+        if (!history.Restore(in, time_offset_ms)) {
+            return false;
+        }
+
+        auto restore_expiry = [time_offset_ms] (std::uint64_t expiry_ms) {
+            return (expiry_ms == GOOD_TILL_CANCELLED) ? expiry_ms : expiry_ms + time_offset_ms;
+        };
+        if (!in.Section(Checkpoint::BOOKS, "books")) {
+            return false;
+        }
+        for (auto& name : names) {
+            auto& book = *books.at(name);
+            auto num_bids = in.Read<std::uint32_t>();
+            for (std::uint32_t i = 0; i < num_bids && in.ok(); i++) {
+                auto expiry_ms = restore_expiry(in.Read<std::uint64_t>());
+                auto order_id = in.Read<std::uint64_t>();
+                auto sender_id = in.Read<int>();
+                auto quantity = in.Read<int>();
+                auto unit_price = Price(in.Read<std::int64_t>());
+                BidOffer offer(sender_id, name, quantity, 0, expiry_ms);
+                offer.order_id = order_id;
+                offer.unit_price = unit_price;
+                BidResult result(sender_id, name, 0);
+                result.order_id = order_id;
+                result.broker_fee_paid = in.Read<bool>();
+                result.quantity_untraded = in.Read<int>();
+                result.quantity_traded = in.Read<int>();
+                result.bought_price = in.Read<double>();
+                result.original_price = in.Read<double>();
+                book.AddBid(std::move(offer), std::move(result));
+            }
+            auto num_asks = in.Read<std::uint32_t>();
+            for (std::uint32_t i = 0; i < num_asks && in.ok(); i++) {
+                auto expiry_ms = restore_expiry(in.Read<std::uint64_t>());
+                auto order_id = in.Read<std::uint64_t>();
+                auto sender_id = in.Read<int>();
+                auto quantity = in.Read<int>();
+                auto unit_price = Price(in.Read<std::int64_t>());
+                AskOffer offer(sender_id, name, quantity, 0, expiry_ms);
+                offer.order_id = order_id;
+                offer.unit_price = unit_price;
+                AskResult result(sender_id, name);
+                result.order_id = order_id;
+                result.broker_fee_paid = in.Read<bool>();
+                result.quantity_untraded = in.Read<int>();
+                result.quantity_traded = in.Read<int>();
+                result.avg_price = in.Read<double>();
+                book.AddAsk(std::move(offer), std::move(result));
+            }
+        }
+        return in.ok();
+    }
+
+    // (remaining quantity, unit price) of every order resting in a book, by order id. Cancels and amends still in
+    // intake aren't reflected. Requires the auction house to be stopped.
+    std::unordered_map<std::uint64_t, std::pair<int, double>> RestingOrders() const {
+        std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+        std::unordered_map<std::uint64_t, std::pair<int, double>> orders;
+        for (auto& [name, book] : books) {
+            std::lock_guard<std::mutex> match_lock(book->match_mutex);
+            for (auto& level : book->bids) {
+                auto& offer = level.second.first;
+                orders[offer.order_id] = {offer.quantity, offer.unit_price.ToDouble()};
+            }
+            for (auto& level : book->asks) {
+                auto& offer = level.second.first;
+                orders[offer.order_id] = {offer.quantity, offer.unit_price.ToDouble()};
+            }
+        }
+        return orders;
+    }
+
+    // Takes effect from the next call to Tick()
+    void SetTickSchedule(const TickSchedule& schedule) {
+        tick_schedule = schedule;
+        tick_interval_ns.store((std::int64_t) schedule.interval_ms*1000000, std::memory_order_relaxed);
+    }
+
+    // Ticks dropped under the SKIP and CATCH_UP policies still count towards `ticks`, so it keeps measuring time
     void Tick(int duration) {
         std::uint64_t expiry_ms = to_unix_timestamp_ms(std::chrono::system_clock::now()) + duration;
+        TraceRecorder::Global().NameThread(unique_name + " tick");
+        TickScheduler scheduler(tick_schedule);
+        scheduler.Start();
         while (!destroyed) {
-            auto t1 = std::chrono::high_resolution_clock::now();
-            for (const auto& item : known_commodities) {
-                ResolveOffers(item.first);
+            auto tick_start = TickScheduler::Clock::now();
+            TraceQueueDepths();
+            {
+                ScopedLatency timer(timings.tick);
+                TraceSpan span("AH Tick");
+                ResolveAllOffers();
+            }
+            if (logger.Enabled(Log::INFO)) {
+                logger.Log(Log::INFO, "Net spread profit for tick" + std::to_string(ticks) + ": " + spread_profit.ToString());
             }
-            logger.Log(Log::INFO, "Net spread profit for tick" + std::to_string(ticks) + ": " + std::to_string(spread_profit));
             ticks++;
+            counters.ticks.fetch_add(1, std::memory_order_relaxed);
             if (to_unix_timestamp_ms(std::chrono::system_clock::now()) > expiry_ms) {
                 logger.Log(Log::ERROR, "Shutting down (expiry time reached)");
                 Shutdown();
             }
 
-            std::chrono::duration<double, std::milli> elapsed_ms = std::chrono::high_resolution_clock::now() - t1;
-            int elapsed = elapsed_ms.count();
-            if (elapsed < TICK_TIME_MS) {
-                std::this_thread::sleep_for(std::chrono::milliseconds{TICK_TIME_MS - elapsed});
-            } else {
-                logger.Log(Log::WARN, "AH thread overran on tick "+ std::to_string(ticks) + ": took " + std::to_string(elapsed) +"/" + std::to_string(TICK_TIME_MS) + "ms )");
+            auto now = TickScheduler::Clock::now();
+            auto interval = scheduler.Interval();
+            auto next = scheduler.Finish(tick_start, now);
+            if (next.overran) {
+                counters.overruns.fetch_add(1, std::memory_order_relaxed);
+                if (logger.Enabled(Log::WARN)) {
+                    std::chrono::duration<double, std::milli> elapsed_ms = now - tick_start;
+                    std::chrono::duration<double, std::milli> interval_ms = interval;
+                    logger.Log(Log::WARN, "AH thread overran on tick "+ std::to_string(ticks) + ": took " + std::to_string(elapsed_ms.count()) +"/" + std::to_string(interval_ms.count()) + "ms, skipping " + std::to_string(next.skipped));
+                }
             }
+            ticks += next.skipped;
+            counters.ticks_skipped.fetch_add(next.skipped, std::memory_order_relaxed);
+            tick_interval_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(scheduler.Interval()).count(), std::memory_order_relaxed);
+            next_tick_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(next.due.time_since_epoch()).count(), std::memory_order_relaxed);
+            std::this_thread::sleep_until(next.due);
         }
+        next_tick_ns.store(0, std::memory_order_relaxed);
     }
 
     void TickOnce() {
-        for (const auto& item : known_commodities) {
-            ResolveOffers(item.first);
+        ScopedLatency timer(timings.tick);
+        TraceSpan span("AH Tick");
+        ResolveAllOffers();
+        if (logger.Enabled(Log::INFO)) {
+            logger.Log(Log::INFO, "Net spread profit: " + spread_profit.ToString());
         }
-        logger.Log(Log::INFO, "Net spread profit: " + std::to_string(spread_profit));
         ticks++;
+        counters.ticks.fetch_add(1, std::memory_order_relaxed);
     }
 private:
+    // Requires known_traders_mutex to be held (shared is enough)
+    Trader* FindTrader(int trader_id) const {
+        auto res = known_traders.find(trader_id);
+        return (res == known_traders.end()) ? nullptr : res->second.get();
+    }
+
+    // Each commodity's book is resolved independently on the worker pool, so a tick takes as long as the busiest
+    // commodity rather than the sum of all of them. Trades touching the same trader from different commodities are
+    // serialised by that trader's settlement mutex.
+    void ResolveAllOffers() {
+        // whatever the message thread couldn't apply while the last pass was matching
+        ApplyRegistryChanges();
+        std::shared_lock<std::shared_mutex> books_lock(books_mutex);
+        std::shared_lock<std::shared_mutex> traders_lock(known_traders_mutex);
+        resolve_pool.ParallelFor(commodity_names.size(), [this] (std::size_t i) {
+            ResolveOffers(commodity_names[i]);
+        });
+    }
+
+    void TraceQueueDepths() {
+        auto& tracer = TraceRecorder::Global();
+        if (tracer.Enabled()) {
+            tracer.Counter("AH queue depth", "inbox", (double) inbox.size());
+            tracer.Counter("AH queue depth", "outbox", (double) outbox.size());
+        }
+    }
+
     // Transaction functions
     bool CheckBidStake(BidOffer& offer) {
-        if (offer.quantity < 0 || offer.unit_price <= 0) {
+        if (offer.quantity < 0 || offer.unit_price <= Price(0)) {
             logger.Log(Log::WARN, "Rejected nonsensical bid: " + offer.ToString());
             return false;
         }
 
         //we refund the agent (if applicable) upon transaction resolution
-        auto res = known_traders[offer.sender_id]->HasMoney(offer.quantity*offer.unit_price);
+        auto* trader = FindTrader(offer.sender_id);
+        if (!trader) {
+            return false;
+        }
+        std::lock_guard<std::mutex> settlement_lock(trader->settlement_mutex);
+        auto res = trader->HasMoney((offer.unit_price*offer.quantity).ToDouble());
         if (!res) {
-            logger.Log(Log::DEBUG, "Failed to take Bid stake: " + offer.ToString());
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to take Bid stake: " + offer.ToString());
+            }
             return false;
         }
         return true;
     }
     bool CheckAskStake(AskOffer& offer) {
-        if (offer.quantity < 0 || offer.unit_price <= 0) {
+        if (offer.quantity < 0 || offer.unit_price <= Price(0)) {
             logger.Log(Log::WARN, "Rejected nonsensical ask: " + offer.ToString());
             return false;
         }
         //we refund the agent (if applicable) upon transaction resolution
-        auto res = known_traders[offer.sender_id]->HasCommodity(offer.commodity, offer.quantity);
+        auto* trader = FindTrader(offer.sender_id);
+        if (!trader) {
+            return false;
+        }
+        std::lock_guard<std::mutex> settlement_lock(trader->settlement_mutex);
+        auto res = trader->HasCommodity(offer.commodity, offer.quantity);
         if (!res) {
-            logger.Log(Log::DEBUG, "Failed to take Ask stake: " + offer.ToString());
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to take Ask stake: " + offer.ToString());
+            }
             return false;
         }
         return true;
@@ -371,7 +905,8 @@ private:
             // partially unfilled
             bid_result.UpdateWithNoTrade(bid.quantity);
         }
-        if (known_traders.find(bid.sender_id) != known_traders.end()) {
+        bid_result.timestamps.closed_ns = monotonic_ns();
+        if (FindTrader(bid.sender_id)) {
             SendMessage(*Message(id).AddBidResult(std::move(bid_result)), bid.sender_id);
         }
     }
@@ -380,7 +915,8 @@ private:
             // partially unfilled
             ask_result.UpdateWithNoTrade(ask.quantity);
         }
-        if (known_traders.find(ask.sender_id) != known_traders.end()) {
+        ask_result.timestamps.closed_ns = monotonic_ns();
+        if (FindTrader(ask.sender_id)) {
             SendMessage(*Message(id).AddAskResult(std::move(ask_result)), ask.sender_id);
         }
     }
@@ -388,132 +924,283 @@ private:
     // 0 - success
     // 1 - seller failed
     // 2 - buyer failed
-    int MakeTransaction(const std::string& commodity, int buyer, int seller, int quantity, double clearing_price) {
+    int MakeTransaction(const std::string& commodity, int buyer, int seller, int quantity, Price clearing_price, Price& profit_this_tick) {
+        auto* seller_trader = FindTrader(seller);
+        if (!seller_trader) {
+            return 1;
+        }
+        auto* buyer_trader = FindTrader(buyer);
+        if (!buyer_trader) {
+            return 2;
+        }
+        // The same trader may be settling other commodities on other workers right now
+        std::unique_lock<std::mutex> seller_lock(seller_trader->settlement_mutex, std::defer_lock);
+        std::unique_lock<std::mutex> buyer_lock(buyer_trader->settlement_mutex, std::defer_lock);
+        if (buyer_trader == seller_trader) {
+            seller_lock.lock();
+        } else {
+            std::lock(seller_lock, buyer_lock);
+        }
+
         // take from seller
-        auto actual_quantity = known_traders[seller]->TryTakeCommodity(commodity, quantity, 0, true);
+        auto actual_quantity = seller_trader->TryTakeCommodity(commodity, quantity, 0, true);
         if (actual_quantity == 0) {
             // this may be unrecoverable, not sure
             logger.Log(Log::WARN, "Seller lacks good! Aborting trade");
             return 1;
         }
-        auto actual_money = known_traders[buyer]->TryTakeMoney(actual_quantity*clearing_price, true);
+        Price sale_value = clearing_price*actual_quantity;
+        auto actual_money = buyer_trader->TryTakeMoney(sale_value.ToDouble(), true);
         if (actual_money == 0) {
             // this may be unrecoverable, not sure
             logger.Log(Log::ERROR, "Buyer lacks money! Aborting trade");
             return 2;
         }
 
-        known_traders[buyer]->TryAddCommodity(commodity, actual_quantity, clearing_price, false);
+        buyer_trader->TryAddCommodity(commodity, actual_quantity, clearing_price.ToDouble(), false);
         //take sales tax from seller
-        double profit = actual_quantity*clearing_price;
-        known_traders[seller]->AddMoney(profit*(1-SALES_TAX));
-        spread_profit += profit*SALES_TAX;
+        Price sales_tax = sale_value.BasisPoints(SALES_TAX_BPS);
+        seller_trader->AddMoney((sale_value - sales_tax).ToDouble());
+        profit_this_tick += sales_tax;
 
-        auto info_msg = std::string("Made trade: ") + std::to_string(seller) + std::string(" >>> ") + std::to_string(buyer) + std::string(" : ") + commodity + std::string(" x") + std::to_string(quantity) + std::string(" @ $") + std::to_string(clearing_price);
-        logger.Log(Log::INFO, info_msg);
+        if (logger.Enabled(Log::INFO)) {
+            auto info_msg = std::string("Made trade: ") + std::to_string(seller) + std::string(" >>> ") + std::to_string(buyer) + std::string(" : ") + commodity + std::string(" x") + std::to_string(quantity) + std::string(" @ $") + clearing_price.ToString();
+            logger.Log(Log::INFO, info_msg);
+        }
         return 0;
     }
 
-    void TakeBrokerFee(BidOffer& offer, BidResult& result) {
-        if (known_traders.find(offer.sender_id) == known_traders.end()) {
-            return; //trader not found
+    bool ChargeBrokerFee(int trader_id, Price notional, Price& profit_this_tick) {
+        auto* trader = FindTrader(trader_id);
+        if (!trader) {
+            return false; //trader not found
         }
-        double fee = offer.quantity*offer.unit_price*BROKER_FEE;
-        auto res = known_traders[offer.sender_id]->TryTakeMoney(fee, true);
+        Price fee = notional.BasisPoints(BROKER_FEE_BPS);
+        std::lock_guard<std::mutex> settlement_lock(trader->settlement_mutex);
+        auto res = trader->TryTakeMoney(fee.ToDouble(), true);
         if (res > 0) {
-            spread_profit += fee;
-            result.broker_fee_paid = true;
-        } else {
-            //failed to take broker fee
-            return;
+            profit_this_tick += fee;
+            return true;
         }
+        //failed to take broker fee
+        return false;
     }
-    void TakeBrokerFee(AskOffer& offer, AskResult& result) {
-        if (known_traders.find(offer.sender_id) == known_traders.end()) {
-            return; //trader not found
+    void TakeBrokerFee(BidOffer& offer, BidResult& result, Price& profit_this_tick) {
+        if (ChargeBrokerFee(offer.sender_id, offer.unit_price*offer.quantity, profit_this_tick)) {
+            result.broker_fee_paid = true;
         }
-        double fee = offer.quantity*offer.unit_price*BROKER_FEE;
-        auto res = known_traders[offer.sender_id]->TryTakeMoney(fee, true);
-        if (res > 0) {
-            spread_profit += fee;
+    }
+    void TakeBrokerFee(AskOffer& offer, AskResult& result, Price& profit_this_tick) {
+        if (ChargeBrokerFee(offer.sender_id, offer.unit_price*offer.quantity, profit_this_tick)) {
             result.broker_fee_paid = true;
-        } else {
-            //failed to take broker fee
-            return;
         }
     }
 
-    bool ValidateBid(BidOffer& curr_bid, BidResult& bid_result, std::int64_t resolve_time) {
-        if (known_traders.find(curr_bid.sender_id) == known_traders.end()) {
+    bool ValidateBid(BidOffer& curr_bid, BidResult& bid_result, Price& profit_this_tick) {
+        if (!FindTrader(curr_bid.sender_id)) {
             return false; //trader not found
         }
-
-        if (curr_bid.expiry_ms == 0) {
-            curr_bid.expiry_ms = 1;
-            bid_result.broker_fee_paid = true; //dont need to pay broker fees for immediate offers
-        } else if (curr_bid.expiry_ms < resolve_time) {
-            return false; //expired bid
-        }
-
         if (!bid_result.broker_fee_paid) {
-            TakeBrokerFee(curr_bid, bid_result);
+            TakeBrokerFee(curr_bid, bid_result, profit_this_tick);
         }
         return (bid_result.broker_fee_paid && CheckBidStake(curr_bid));
     }
 
-    bool ValidateAsk(AskOffer& curr_ask, AskResult& ask_result, std::int64_t resolve_time) {
-        if (known_traders.find(curr_ask.sender_id) == known_traders.end()) {
+    bool ValidateAsk(AskOffer& curr_ask, AskResult& ask_result, Price& profit_this_tick) {
+        if (!FindTrader(curr_ask.sender_id)) {
             return false; //trader not found
         }
-        if (curr_ask.expiry_ms == 0) {
-            curr_ask.expiry_ms = 1;
-            ask_result.broker_fee_paid = true; //dont need to pay broker fees for immediate offers
-        } else if (curr_ask.expiry_ms < resolve_time) {
-            return false; //expired bid
-        }
-
         if (!ask_result.broker_fee_paid) {
-            TakeBrokerFee(curr_ask, ask_result);
+            TakeBrokerFee(curr_ask, ask_result, profit_this_tick);
         }
         return (ask_result.broker_fee_paid && CheckAskStake(curr_ask));
     }
 
-    void ResolveOffers(const std::string& commodity) {
-        bid_book_mutex.lock();
-        ask_book_mutex.lock();
+    // Closes the orders whose expiry has passed, then moves new orders into the book and indexes them by expiry, then
+    // applies cancels and amends. Immediate orders (expiry 0) skip the broker fee and are due at the next resolution.
+    void AcceptAndExpire(OrderBook& book, std::uint64_t resolve_time, Price& profit_this_tick) {
+        for (auto& expired : book.PopExpired(resolve_time)) {
+            if (expired.is_bid) {
+                if (auto it = book.FindBid(expired.order_id)) {
+                    CloseBid((*it)->second.first, std::move((*it)->second.second));
+                    book.EraseBid(*it);
+                }
+            } else {
+                if (auto it = book.FindAsk(expired.order_id)) {
+                    CloseAsk((*it)->second.first, std::move((*it)->second.second));
+                    book.EraseAsk(*it);
+                }
+            }
+        }
 
-        std::vector<std::pair<BidOffer, BidResult>> retained_bids = {};
-        std::vector<std::pair<AskOffer, AskResult>> retained_asks = {};
+        auto& incoming = book.TakeIncoming();
+        for (auto& entry : incoming.bids) {
+            auto& offer = entry.first;
+            if (offer.expiry_ms == 0) {
+                offer.expiry_ms = resolve_time;
+                entry.second.broker_fee_paid = true; //dont need to pay broker fees for immediate offers
+            }
+            if (offer.expiry_ms == GOOD_TILL_CANCELLED || book.expiries.Schedule(offer.expiry_ms, {offer.order_id, true})) {
+                book.InsertBid(std::move(entry));
+            } else {
+                CloseBid(offer, std::move(entry.second)); //expired before it reached the book
+            }
+        }
+        for (auto& entry : incoming.asks) {
+            auto& offer = entry.first;
+            if (offer.expiry_ms == 0) {
+                offer.expiry_ms = resolve_time;
+                entry.second.broker_fee_paid = true; //dont need to pay broker fees for immediate offers
+            }
+            if (offer.expiry_ms == GOOD_TILL_CANCELLED || book.expiries.Schedule(offer.expiry_ms, {offer.order_id, false})) {
+                book.InsertAsk(std::move(entry));
+            } else {
+                CloseAsk(offer, std::move(entry.second)); //expired before it reached the book
+            }
+        }
+
+        for (auto& cancel : incoming.cancels) {
+            if (cancel.is_bid) {
+                auto it = book.FindBid(cancel.order_id);
+                if (it && (*it)->second.first.sender_id == cancel.sender_id) {
+                    CloseBid((*it)->second.first, std::move((*it)->second.second));
+                    book.EraseBid(*it);
+                }
+            } else {
+                auto it = book.FindAsk(cancel.order_id);
+                if (it && (*it)->second.first.sender_id == cancel.sender_id) {
+                    CloseAsk((*it)->second.first, std::move((*it)->second.second));
+                    book.EraseAsk(*it);
+                }
+            }
+        }
+        for (auto& amend : incoming.amends) {
+            if (amend.is_bid) {
+                if (auto it = book.FindBid(amend.order_id)) {
+                    AmendBid(book, *it, amend, profit_this_tick);
+                }
+            } else {
+                if (auto it = book.FindAsk(amend.order_id)) {
+                    AmendAsk(book, *it, amend, profit_this_tick);
+                }
+            }
+        }
+        // Orders that have already been filled, cancelled or expired are silently ignored by the above: their final
+        // result is on its way to the trader
+    }
+
+    // Amending to a larger notional pays the broker fee on the difference; if that fails the amend is dropped
+    void AmendBid(OrderBook& book, OrderBook::BidQueue::iterator it, const AmendOrder& amend, Price& profit_this_tick) {
+        auto& [offer, result] = it->second;
+        if (offer.sender_id != amend.sender_id) {
+            logger.Log(Log::WARN, "Rejected amend of another trader's order: " + amend.ToString());
+            return;
+        }
+        if (amend.quantity <= 0) {
+            CloseBid(offer, std::move(result));
+            book.EraseBid(it);
+            return;
+        }
+        Price extra_notional = amend.unit_price*amend.quantity - offer.unit_price*offer.quantity;
+        if (extra_notional > Price(0) && result.broker_fee_paid && !ChargeBrokerFee(offer.sender_id, extra_notional, profit_this_tick)) {
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to take broker fee for amend: " + amend.ToString());
+            }
+            return;
+        }
+        bool keeps_priority = (amend.unit_price == offer.unit_price && amend.quantity <= offer.quantity);
+        offer.quantity = amend.quantity;
+        result.original_price = amend.unit_price.ToDouble();
+        if (!keeps_priority) {
+            book.RequeueBid(it, amend.unit_price);
+        }
+    }
+    void AmendAsk(OrderBook& book, OrderBook::AskQueue::iterator it, const AmendOrder& amend, Price& profit_this_tick) {
+        auto& [offer, result] = it->second;
+        if (offer.sender_id != amend.sender_id) {
+            logger.Log(Log::WARN, "Rejected amend of another trader's order: " + amend.ToString());
+            return;
+        }
+        if (amend.quantity <= 0) {
+            CloseAsk(offer, std::move(result));
+            book.EraseAsk(it);
+            return;
+        }
+        Price extra_notional = amend.unit_price*amend.quantity - offer.unit_price*offer.quantity;
+        if (extra_notional > Price(0) && result.broker_fee_paid && !ChargeBrokerFee(offer.sender_id, extra_notional, profit_this_tick)) {
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to take broker fee for amend: " + amend.ToString());
+            }
+            return;
+        }
+        bool keeps_priority = (amend.unit_price == offer.unit_price && amend.quantity <= offer.quantity);
+        offer.quantity = amend.quantity;
+        if (!keeps_priority) {
+            book.RequeueAsk(it, amend.unit_price);
+        }
+    }
+
+    // Sends an interim result to every order that traded this resolution and is still resting
+    void ReportOpenFills(OrderBook& book) {
+        for (auto order_id : book.traded_bids) {
+            if (auto it = book.FindBid(order_id)) {
+                auto& result = (*it)->second.second;
+                BidResult interim = result;
+                interim.closed = false;
+                SendMessage(*Message(id).AddBidResult(std::move(interim)), (*it)->second.first.sender_id);
+                result.ClearTrades();
+            }
+        }
+        for (auto order_id : book.traded_asks) {
+            if (auto it = book.FindAsk(order_id)) {
+                auto& result = (*it)->second.second;
+                AskResult interim = result;
+                interim.closed = false;
+                SendMessage(*Message(id).AddAskResult(std::move(interim)), (*it)->second.first.sender_id);
+                result.ClearTrades();
+            }
+        }
+        book.traded_bids.clear();
+        book.traded_asks.clear();
+    }
+
+    // Requires books_mutex and known_traders_mutex to be held (shared is enough)
+    void ResolveOffers(const std::string& commodity) {
+        TraceSpan span("ResolveOffers", commodity.c_str());
+        auto& book = *books.at(commodity);
+        std::lock_guard<std::mutex> book_lock(book.match_mutex);
+        LapTimer phase_timer;
 
         auto resolve_time = to_unix_timestamp_ms(std::chrono::system_clock::now());
+        auto resolve_ns = monotonic_ns();
+        Price profit_this_tick;
 
-        auto& bids = bid_book[commodity];
-        auto& asks = ask_book[commodity];
-//
-//        std::shuffle(bids.begin(), bids.end(), rng_gen);
-//        std::shuffle(bids.begin(), bids.end(), rng_gen);
+        AcceptAndExpire(book, resolve_time, profit_this_tick);
+        phase_timer.Lap(timings.resolve_intake);
 
-        std::sort(bids.rbegin(), bids.rend()); // NOTE: Reversed order
-        std::sort(asks.rbegin(), asks.rend());   // lowest selling price first
+        auto& bids = book.bids;
+        auto& asks = book.asks;
 
         int num_trades_this_tick = 0;
-        double money_traded_this_tick = 0;
+        Price money_traded_this_tick;
+        Price money_bid_this_tick;  // what the buyers offered for the units traded
         double units_traded_this_tick = 0;
 
-        double avg_buy_price_this_tick = 0;
-        double avg_price_this_tick = 0;
-
         double supply = 0;
         double demand = 0;
         {
             auto it = bids.begin();
             while (it != bids.end()) {
-                if (!ValidateBid(it->first, it->second, resolve_time)) {
-                    CloseBid(it->first, std::move(it->second));
-                    bids.erase(it);
+                auto& [curr_bid, bid_result] = it->second;
+                if (bid_result.timestamps.resolved_ns == 0) {
+                    bid_result.timestamps.resolved_ns = resolve_ns;
+                }
+                if (!ValidateBid(curr_bid, bid_result, profit_this_tick)) {
+                    CloseBid(curr_bid, std::move(bid_result));
+                    it = book.EraseBid(it);
                 }
                 else  {
-                    demand += it->first.quantity;
+                    demand += curr_bid.quantity;
                     ++it;
                 }
             }
@@ -521,84 +1208,96 @@ private:
         {
             auto it = asks.begin();
             while (it != asks.end()) {
-                if (!ValidateAsk(it->first, it->second, resolve_time)) {
-                    CloseAsk(it->first, std::move(it->second));
-                    asks.erase(it);
+                auto& [curr_ask, ask_result] = it->second;
+                if (ask_result.timestamps.resolved_ns == 0) {
+                    ask_result.timestamps.resolved_ns = resolve_ns;
+                }
+                if (!ValidateAsk(curr_ask, ask_result, profit_this_tick)) {
+                    CloseAsk(curr_ask, std::move(ask_result));
+                    it = book.EraseAsk(it);
                 }
                 else  {
-                    supply += it->first.quantity;
+                    supply += curr_ask.quantity;
                     ++it;
                 }
             }
         }
+        phase_timer.Lap(timings.resolve_validate);
         while (!bids.empty() && !asks.empty()) {
-            BidOffer& curr_bid = bids[0].first;
-            AskOffer& curr_ask = asks[0].first;
+            BidOffer& curr_bid = bids.begin()->second.first;
+            AskOffer& curr_ask = asks.begin()->second.first;
 
-            BidResult& bid_result = bids[0].second;
-            AskResult& ask_result = asks[0].second;
+            BidResult& bid_result = bids.begin()->second.second;
+            AskResult& ask_result = asks.begin()->second.second;
 
             if (curr_ask.unit_price > curr_bid.unit_price) {
                 break;
             }
 
             int quantity_traded = std::min(curr_bid.quantity, curr_ask.quantity);
-            double clearing_price = curr_ask.unit_price;
+            Price clearing_price = curr_ask.unit_price;
 
             if (quantity_traded > 0) {
                 // MAKE TRANSACTION
                 int buyer = curr_bid.sender_id;
                 int seller = curr_ask.sender_id;
-                auto res = MakeTransaction(commodity, buyer, seller, quantity_traded, clearing_price);
+                auto res = MakeTransaction(commodity, buyer, seller, quantity_traded, clearing_price, profit_this_tick);
                 if (res == 1) {
                     //seller failed
                     CloseAsk(curr_ask, std::move(ask_result));
-                    asks.erase(asks.begin());
+                    book.EraseAsk(asks.begin());
                     break;
                 }
                 if (res == 2) {
                     //buyer failed
                     CloseBid(curr_bid, std::move(bid_result));
-                    bids.erase(bids.begin());
+                    book.EraseBid(bids.begin());
                     break;
                 }
                 // update the offers and results
                 curr_bid.quantity -= quantity_traded;
                 curr_ask.quantity -= quantity_traded;
+                if (bid_result.quantity_traded == 0) {
+                    book.traded_bids.push_back(curr_bid.order_id);
+                }
+                if (ask_result.quantity_traded == 0) {
+                    book.traded_asks.push_back(curr_ask.order_id);
+                }
 
                 bid_result.UpdateWithTrade(quantity_traded, clearing_price);
                 ask_result.UpdateWithTrade(quantity_traded, clearing_price);
+                if (bid_result.timestamps.filled_ns == 0 || ask_result.timestamps.filled_ns == 0) {
+                    auto fill_ns = monotonic_ns();
+                    if (bid_result.timestamps.filled_ns == 0) {
+                        bid_result.timestamps.filled_ns = fill_ns;
+                    }
+                    if (ask_result.timestamps.filled_ns == 0) {
+                        ask_result.timestamps.filled_ns = fill_ns;
+                    }
+                }
 
                 // update per-tick metrics
-                avg_price_this_tick = (avg_price_this_tick*units_traded_this_tick + clearing_price*quantity_traded)/(units_traded_this_tick + quantity_traded);
-                avg_buy_price_this_tick = (avg_buy_price_this_tick*units_traded_this_tick + curr_bid.unit_price*quantity_traded)/(units_traded_this_tick + quantity_traded);
-
                 units_traded_this_tick += quantity_traded;
-                money_traded_this_tick += quantity_traded*clearing_price;
+                money_traded_this_tick += clearing_price*quantity_traded;
+                money_bid_this_tick += curr_bid.unit_price*quantity_traded;
                 num_trades_this_tick += 1;
             }
 
-            if (curr_bid.quantity <= 0) {
+            bool bid_filled = curr_bid.quantity <= 0;
+            bool ask_filled = curr_ask.quantity <= 0;
+            if (bid_filled) {
                 // Fulfilled buy order
                 CloseBid(curr_bid, std::move(bid_result));
-                bids.erase(bids.begin());
+                book.EraseBid(bids.begin());
             }
-            if (curr_ask.quantity <= 0) {
+            if (ask_filled) {
                 // Fulfilled sell order
                 CloseAsk(curr_ask, std::move(ask_result));
-                asks.erase(asks.begin());
+                book.EraseAsk(asks.begin());
             }
         }
-
-        for (auto bid : bids) {
-            //optionally could return a partial-result here
-            retained_bids.emplace_back(std::move(bid));
-        }
-        for (auto ask : asks) {
-            retained_asks.emplace_back(std::move(ask));
-        }
-        bid_book[commodity] = std::move(retained_bids);
-        ask_book[commodity] = std::move(retained_asks);
+        ReportOpenFills(book);
+        phase_timer.Lap(timings.resolve_match);
         // update history
         history.asks.add(commodity, supply);
         history.bids.add(commodity, demand);
@@ -606,16 +1305,18 @@ private:
         history.trades.add(commodity, num_trades_this_tick);
 
         if (units_traded_this_tick > 0) {
-            history.buy_prices.add(commodity, avg_buy_price_this_tick);
-            history.prices.add(commodity, avg_price_this_tick);
+            history.buy_prices.add(commodity, money_bid_this_tick.ToDouble()/units_traded_this_tick);
+            history.prices.add(commodity, money_traded_this_tick.ToDouble()/units_traded_this_tick);
         } else {
             // Set to same as last-tick's average if no trades occurred
             history.buy_prices.add(commodity, history.buy_prices.average(commodity, 1));
             history.prices.add(commodity, history.prices.average(commodity, 1));
         }
+        phase_timer.Lap(timings.resolve_history);
+        TraceRecorder::Global().Counter("trades", commodity.c_str(), num_trades_this_tick);
 
-    bid_book_mutex.unlock();
-    ask_book_mutex.unlock();
+        std::lock_guard<std::mutex> profit_lock(spread_profit_mutex);
+        spread_profit += profit_this_tick;
     }
 
 };
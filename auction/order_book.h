@@ -0,0 +1,171 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_ORDER_BOOK_H
+#define CPPBAZAARBOT_ORDER_BOOK_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../common/messages.h"
+#include "../common/price.h"
+#include "../common/timing_wheel.h"
+
+// Identifies a resting order for the expiry index
+struct OrderRef {
+    std::uint64_t order_id;
+    bool is_bid;
+};
+
+// Resting orders for a single commodity. Books for different commodities never touch each other, so each has its
+// own locks and the auction house can resolve them in parallel.
+//
+// Each side is kept in price-time priority (best price first, then arrival order), with an index from order id to
+// entry so any order can be removed directly, eg when it expires.
+//
+// Map and index nodes come from a pool owned by the book, so steady-state trading recycles the nodes of closed orders
+// instead of going back to the heap.
+//
+// New orders, amends and cancels are double-buffered: the message thread only ever appends to the incoming buffers under intake_mutex,
+// and the matching thread swaps them out at the start of each resolution, so intake never waits on a matching pass.
+struct OrderBook {
+    using BidEntry = std::pair<BidOffer, BidResult>;
+    using AskEntry = std::pair<AskOffer, AskResult>;
+    using BidQueue = std::pmr::multimap<Price, BidEntry, std::greater<Price>>;     // highest bid first
+    using AskQueue = std::pmr::multimap<Price, AskEntry>;                          // lowest ask first
+
+private:
+    std::pmr::unsynchronized_pool_resource node_pool;   // declared first: outlives everything allocated from it
+public:
+    std::mutex match_mutex;     // held for a whole resolution; guards everything below down to intake_mutex
+    BidQueue bids{&node_pool};
+    AskQueue asks{&node_pool};
+    TimingWheel<OrderRef> expiries;                 // good-till-cancelled orders are not scheduled
+    std::vector<std::uint64_t> traded_bids = {};    // orders that traded during the current resolution
+    std::vector<std::uint64_t> traded_asks = {};
+
+    // Everything received for this book between two resolutions
+    struct Intake {
+        std::vector<BidEntry> bids = {};
+        std::vector<AskEntry> asks = {};
+        std::vector<AmendOrder> amends = {};
+        std::vector<CancelOrder> cancels = {};
+
+        void clear() {
+            bids.clear();
+            asks.clear();
+            amends.clear();
+            cancels.clear();
+        }
+    };
+
+    std::mutex intake_mutex;    // held only to append or swap; guards incoming
+    Intake incoming;
+
+    void AddBid(BidOffer offer, BidResult result) {
+        std::lock_guard<std::mutex> lock(intake_mutex);
+        incoming.bids.emplace_back(std::move(offer), std::move(result));
+    }
+    void AddAsk(AskOffer offer, AskResult result) {
+        std::lock_guard<std::mutex> lock(intake_mutex);
+        incoming.asks.emplace_back(std::move(offer), std::move(result));
+    }
+    void AddAmend(AmendOrder amend) {
+        std::lock_guard<std::mutex> lock(intake_mutex);
+        incoming.amends.push_back(std::move(amend));
+    }
+    void AddCancel(CancelOrder cancel) {
+        std::lock_guard<std::mutex> lock(intake_mutex);
+        incoming.cancels.push_back(std::move(cancel));
+    }
+
+    // Swaps out everything received since the last call. The returned buffers belong to the book and are only valid
+    // until the next call; they keep their capacity, so steady-state intake doesn't reallocate. Requires match_mutex.
+    Intake& TakeIncoming() {
+        staged.clear();
+        std::lock_guard<std::mutex> lock(intake_mutex);
+        std::swap(staged, incoming);
+        return staged;
+    }
+
+    // Requires match_mutex for all of the below
+    BidQueue::iterator InsertBid(BidEntry entry) {
+        auto order_id = entry.first.order_id;
+        auto it = bids.emplace(entry.first.unit_price, std::move(entry));
+        bid_index[order_id] = it;
+        return it;
+    }
+    AskQueue::iterator InsertAsk(AskEntry entry) {
+        auto order_id = entry.first.order_id;
+        auto it = asks.emplace(entry.first.unit_price, std::move(entry));
+        ask_index[order_id] = it;
+        return it;
+    }
+
+    BidQueue::iterator EraseBid(BidQueue::iterator it) {
+        bid_index.erase(it->second.first.order_id);
+        return bids.erase(it);
+    }
+    AskQueue::iterator EraseAsk(AskQueue::iterator it) {
+        ask_index.erase(it->second.first.order_id);
+        return asks.erase(it);
+    }
+
+    // Moves an order to the back of the queue at unit_price, as if it had just arrived there
+    BidQueue::iterator RequeueBid(BidQueue::iterator it, Price unit_price) {
+        auto node = bids.extract(it);
+        node.key() = unit_price;
+        node.mapped().first.unit_price = unit_price;
+        auto requeued = bids.insert(std::move(node));
+        bid_index[requeued->second.first.order_id] = requeued;
+        return requeued;
+    }
+    AskQueue::iterator RequeueAsk(AskQueue::iterator it, Price unit_price) {
+        auto node = asks.extract(it);
+        node.key() = unit_price;
+        node.mapped().first.unit_price = unit_price;
+        auto requeued = asks.insert(std::move(node));
+        ask_index[requeued->second.first.order_id] = requeued;
+        return requeued;
+    }
+
+    std::optional<BidQueue::iterator> FindBid(std::uint64_t order_id) {
+        auto res = bid_index.find(order_id);
+        if (res == bid_index.end()) {
+            return std::nullopt;
+        }
+        return res->second;
+    }
+    std::optional<AskQueue::iterator> FindAsk(std::uint64_t order_id) {
+        auto res = ask_index.find(order_id);
+        if (res == ask_index.end()) {
+            return std::nullopt;
+        }
+        return res->second;
+    }
+
+    // Every order that expires strictly before now_ms. Orders that have already left the book are still reported;
+    // look them up with FindBid/FindAsk and skip the ones that are gone.
+    std::vector<OrderRef>& PopExpired(std::uint64_t now_ms) {
+        expired.clear();
+        expiries.Advance(now_ms, expired);
+        return expired;
+    }
+
+private:
+    std::pmr::unordered_map<std::uint64_t, BidQueue::iterator> bid_index{&node_pool};
+    std::pmr::unordered_map<std::uint64_t, AskQueue::iterator> ask_index{&node_pool};
+    std::vector<OrderRef> expired;
+
+    Intake staged;
+};
+
+#endif//CPPBAZAARBOT_ORDER_BOOK_H
@@ -0,0 +1,195 @@
+//
+// Created by henry on 18/10/2026.
+//
+// Decision throughput of the batched (structure-of-arrays) AI engine: splits a population evenly across the default
+// roles and times TickRoles() + GenerateOffers() against a fixed market snapshot, then times AITrader::TickOnce() on a
+// small sample of ordinary AI traders for comparison.
+// With with_market=1 the populations are also registered with an AuctionHouse, which matches their offers between
+// ticks and settles straight into the columns.
+//
+// Usage: batched_ai_bench [num_traders] [iterations] [with_market] [sample_traders]
+//   num_traders     batched traders across all roles (default 1000000)
+//   iterations      timed ticks (default 20)
+//   with_market     0 | 1 (default 0)
+//   sample_traders  AITraders for the comparison, 0 to skip (default 120)
+//
+#include "../outerspatial_engine.h"
+#include "../traders/batched_ai.h"
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+struct BatchedBenchConfig {
+    int num_traders = 1000000;
+    int iterations = 20;
+    bool with_market = false;
+    int sample_traders = 120;
+    double market_price = 10;
+    unsigned int seed = 42;
+};
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::unique_ptr<BatchedPopulation>> MakePopulations(const BatchedBenchConfig& config, const Economy& economy,
+                                                                Rng& gen) {
+    std::uniform_real_distribution<> random_money(250, 750);
+    std::uniform_real_distribution<> random_cost(9, 11);
+    std::vector<std::unique_ptr<BatchedPopulation>> populations;
+    int per_role = config.num_traders / (int) economy.roles.size();
+    for (std::size_t i = 0; i < economy.roles.size(); i++) {
+        auto& role = economy.roles[i];
+        populations.push_back(std::make_unique<BatchedPopulation>(role, 20, i));
+        auto market = MarketSnapshot::Uniform(role.inventory.size(), config.market_price);
+        for (int j = 0; j < per_role; j++) {
+            populations.back()->Add(random_money(gen), random_cost(gen), role.inventory, market);
+        }
+    }
+    return populations;
+}
+
+double TimeSampleAITraders(const BatchedBenchConfig& config, const Economy& economy, Rng& gen) {
+    auto auction_house = std::make_shared<AuctionHouse>(0, Log::ERROR);
+    for (auto& commodity : economy.commodities) {
+        auction_house->RegisterCommodity(commodity);
+    }
+    std::vector<std::shared_ptr<AITrader>> traders;
+    for (int i = 0; i < config.sample_traders; i++) {
+        traders.push_back(MakeAgent(economy, i % (int) economy.roles.size(), i + 1, auction_house, gen, 1000, Log::ERROR));
+    }
+    // let registration responses arrive so the traders start generating offers
+    std::this_thread::sleep_for(std::chrono::milliseconds{500});
+
+    int trader_ticks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.iterations; i++) {
+        for (auto& trader : traders) {
+            trader->TickOnce();
+            trader_ticks++;
+        }
+    }
+    double elapsed_s = SecondsSince(start);
+
+    for (auto& trader : traders) {
+        trader->Shutdown();
+    }
+    auction_house->Shutdown();
+    return (elapsed_s > 0) ? trader_ticks/elapsed_s : 0;
+}
+
+int RunBench(const BatchedBenchConfig& config) {
+    std::filesystem::create_directories("logs");
+    Rng::SetGlobalSeed(config.seed);
+    Rng gen = Rng::Stream(Rng::DRIVER_STREAM);
+    auto& economy = Economy::Default();
+    auto populations = MakePopulations(config, economy, gen);
+    std::vector<MarketSnapshot> markets;
+    for (auto& population : populations) {
+        markets.push_back(MarketSnapshot::Uniform(population->Commodities().size(), config.market_price));
+    }
+
+    std::shared_ptr<AuctionHouse> auction_house;
+    double register_s = 0;
+    if (config.with_market) {
+        auction_house = std::make_shared<AuctionHouse>(0, Log::ERROR);
+        // We tick the AH ourselves, between population ticks, as BatchedPopulation requires
+        auction_house->ShutdownMessageThread();
+        for (auto& commodity : economy.commodities) {
+            auction_house->RegisterCommodity(commodity);
+        }
+        auto register_start = std::chrono::steady_clock::now();
+        int next_id = 1;
+        for (auto& population : populations) {
+            population->Register(*auction_house, next_id);
+        }
+        while (auction_house->InboxSize() > 0) {
+            auction_house->FlushInbox();
+        }
+        while (auction_house->OutboxSize() > 0) {
+            auction_house->FlushOutbox();
+        }
+        register_s = SecondsSince(register_start);
+    }
+
+    std::vector<BatchedOffer> bids;
+    std::vector<BatchedOffer> asks;
+    std::uint64_t trader_ticks = 0;
+    std::uint64_t total_offers = 0;
+    std::uint64_t units_traded = 0;
+    double decide_s = 0;
+    double market_s = 0;
+    for (int i = 0; i < config.iterations; i++) {
+        for (std::size_t p = 0; p < populations.size(); p++) {
+            auto& population = *populations[p];
+            bids.clear();
+            asks.clear();
+
+            trader_ticks += population.NumAlive();
+            auto start = std::chrono::steady_clock::now();
+            population.TickRoles();
+            population.GenerateOffers(markets[p], bids, asks);
+            decide_s += SecondsSince(start);
+            total_offers += bids.size() + asks.size();
+
+            if (auction_house) {
+                auto market_start = std::chrono::steady_clock::now();
+                population.Submit(*auction_house, bids, asks);
+                market_s += SecondsSince(market_start);
+            }
+        }
+        if (auction_house) {
+            auto market_start = std::chrono::steady_clock::now();
+            while (auction_house->InboxSize() > 0) {
+                auction_house->FlushInbox();
+            }
+            auction_house->TickOnce();
+            while (auction_house->OutboxSize() > 0) {
+                auction_house->FlushOutbox();
+            }
+            for (std::size_t p = 0; p < populations.size(); p++) {
+                units_traded += populations[p]->DrainResults();
+                markets[p] = MarketSnapshot::FromAuctionHouse(*auction_house, populations[p]->Commodities(), 1000);
+            }
+            market_s += SecondsSince(market_start);
+        }
+    }
+
+    int alive = 0;
+    for (auto& population : populations) {
+        alive += population->NumAlive();
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "traders=" << config.num_traders << " iterations=" << config.iterations
+              << " market=" << (config.with_market ? "on" : "off") << "\n";
+    std::cout << "trader-ticks/s: " << ((decide_s > 0) ? trader_ticks/decide_s : 0) << "\n";
+    std::cout << "ns/trader-tick: " << ((trader_ticks > 0) ? 1e9*decide_s/trader_ticks : 0) << "\n";
+    std::cout << "offers/tick:    " << (double) total_offers/config.iterations << "\n";
+    std::cout << "alive at end:   " << alive << "\n";
+    if (auction_house) {
+        std::cout << "register ms:    " << 1e3*register_s << "\n";
+        std::cout << "market ms/tick: " << 1e3*market_s/config.iterations << "\n";
+        std::cout << "units traded:   " << units_traded << "\n";
+        for (auto& population : populations) {
+            population->Deregister(*auction_house);
+        }
+        while (auction_house->InboxSize() > 0) {
+            auction_house->FlushInbox();
+        }
+    }
+    if (config.sample_traders > 0) {
+        double ai_rate = TimeSampleAITraders(config, economy, gen);
+        std::cout << "AITrader trader-ticks/s (" << config.sample_traders << " traders): " << ai_rate << "\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    BatchedBenchConfig config;
+    if (argc > 1) config.num_traders = std::stoi(std::string(argv[1]));
+    if (argc > 2) config.iterations = std::stoi(std::string(argv[2]));
+    if (argc > 3) config.with_market = std::stoi(std::string(argv[3])) != 0;
+    if (argc > 4) config.sample_traders = std::stoi(std::string(argv[4]));
+    return RunBench(config);
+}
@@ -0,0 +1,102 @@
+//
+// Created by henry on 18/10/2026.
+//
+// Synthetic load generator: a single FakeTrader in load-generator mode drives a live AuctionHouse (its own tick and
+// message threads, as in the driver) at a target order rate, and reports achieved throughput and order
+// acknowledgement latency.
+//
+// Usage: loadgen [duration_s] [orders_per_second] [num_commodities] [burst_multiplier] [burst_period_ms] [burst_duration_ms]
+//   duration_s         (default 10)
+//   orders_per_second  base rate (default 20000)
+//   num_commodities    (default 6)
+//   burst_multiplier   rate multiplier during bursts, 1 disables bursts (default 1)
+//   burst_period_ms    (default 1000)
+//   burst_duration_ms  (default 100)
+//
+#include "../outerspatial_engine.h"
+#include <filesystem>
+#include <iostream>
+
+struct LoadGenConfig {
+    double duration_s = 10;
+    int num_commodities = 6;
+    int tick_time_ms = 1;
+    unsigned int seed = 42;
+    LoadProfile profile;
+};
+
+int RunLoadGen(LoadGenConfig& config) {
+    std::filesystem::create_directories("logs");
+
+    int max_id = 0;
+    auto auction_house = std::make_shared<AuctionHouse>(max_id, Log::ERROR);
+    max_id++;
+    for (int i = 0; i < config.num_commodities; i++) {
+        config.profile.commodities.push_back("commodity" + std::to_string(i));
+        auction_house->RegisterCommodity(Commodity(config.profile.commodities.back(), 1));
+    }
+    int duration_ms = (int) (config.duration_s*1000);
+    std::thread auction_house_thread(&AuctionHouse::Tick, auction_house, duration_ms + 60*1000);
+
+    auto generator = std::make_shared<FakeTrader>(max_id, auction_house);
+    max_id++;
+    generator->SendMessage(*Message(generator->id).AddRegisterRequest(RegisterRequest(generator->id, generator)), auction_house->id);
+    generator->FlushOutbox();
+    generator->EnableLoadGeneration(config.profile, config.seed);
+
+    auto start = std::chrono::steady_clock::now();
+    int elapsed = 0;
+    while (elapsed < duration_ms) {
+        auto t1 = std::chrono::steady_clock::now();
+        generator->Tick();
+        auto work_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
+        if (work_ms < config.tick_time_ms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{config.tick_time_ms - work_ms});
+        }
+        elapsed = (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    double sent_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Let outstanding orders resolve and their results come back before stopping the AH
+    for (int i = 0; i < 100 && generator->results_received + generator->orders_refused < generator->orders_sent; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        generator->FlushInbox();
+    }
+    auction_house->Shutdown();
+    auction_house_thread.join();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "target rate:     " << config.profile.orders_per_second << " orders/s";
+    if (config.profile.burst_period_ms > 0 && config.profile.burst_multiplier != 1) {
+        std::cout << " (x" << config.profile.burst_multiplier << " for " << config.profile.burst_duration_ms
+                  << "ms every " << config.profile.burst_period_ms << "ms)";
+    }
+    std::cout << "\n";
+    std::cout << "orders sent:     " << generator->orders_sent << " (" << generator->orders_sent/sent_s << "/s)\n";
+    std::cout << "refused:         " << generator->orders_refused << " (AH inbox full)\n";
+    std::cout << "results:         " << generator->results_received << " ("
+              << generator->orders_sent - std::min(generator->orders_sent, generator->results_received + generator->orders_refused) << " outstanding)\n";
+    std::cout << "AH messages:     " << auction_house->counters.messages_received << " received, "
+              << auction_house->counters.messages_sent << " sent\n";
+    std::cout << "AH overruns:     " << auction_house->counters.overruns << "/" << auction_house->counters.ticks << " ticks\n\n";
+    std::cout << generator->ack_latency.Summary() << "\n\n";
+    std::cout << "Order lifecycle latencies:\n" << generator->order_latency.Summary() << "\n";
+    std::cout << "AH phase timings:\n" << auction_house->timings.Summary() << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    LoadGenConfig config;
+    config.profile.orders_per_second = 20000;
+    if (argc > 1) config.duration_s = std::stod(std::string(argv[1]));
+    if (argc > 2) config.profile.orders_per_second = std::stod(std::string(argv[2]));
+    if (argc > 3) config.num_commodities = std::stoi(std::string(argv[3]));
+    if (argc > 4) {
+        config.profile.burst_multiplier = std::stod(std::string(argv[4]));
+        config.profile.burst_period_ms = 1000;
+        config.profile.burst_duration_ms = 100;
+    }
+    if (argc > 5) config.profile.burst_period_ms = std::stoi(std::string(argv[5]));
+    if (argc > 6) config.profile.burst_duration_ms = std::stoi(std::string(argv[6]));
+    return RunLoadGen(config);
+}
@@ -0,0 +1,275 @@
+//
+// Created by henry on 18/10/2026.
+//
+// Microbenchmark for the matching engine: fills an AuctionHouse's books with synthetic orders from stub traders,
+// then times TickOnce() in isolation.
+//
+// Usage: bench [depth] [num_commodities] [iterations] [distribution] [num_traders] [resolve_workers]
+//   depth           bids and asks per commodity per tick (default 1000)
+//   num_commodities (default 6)
+//   iterations      timed ticks (default 200)
+//   distribution    uniform | normal | crossed | disjoint (default uniform)
+//   num_traders     stub traders placing the orders (default 100)
+//   resolve_workers AH worker threads resolving commodities in parallel (default one per extra core)
+//
+#include "../outerspatial_engine.h"
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <random>
+
+// Count every heap allocation made by the process, so we can report allocations per tick. The whole replaceable
+// family is defined, so that array and over-aligned allocations are counted too, and every delete matches its new.
+namespace {
+    std::atomic<std::uint64_t> num_allocations{0};
+
+    void* CountedAlloc(std::size_t size) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+    void* CountedAlloc(std::size_t size, std::align_val_t alignment) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        auto align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants a whole number of alignments
+        return std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+    }
+    // malloc and aligned_alloc memory are both released with free. Kept out of line: inlined into a delete, GCC would
+    // see free called on memory from operator new and warn about the mismatch.
+    [[gnu::noinline]] void Release(void* ptr) {
+        std::free(ptr);
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* ptr = CountedAlloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* ptr = CountedAlloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* ptr = CountedAlloc(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* ptr = CountedAlloc(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    Release(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept {
+    Release(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    Release(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    Release(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    Release(ptr);
+}
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    Release(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    Release(ptr);
+}
+
+struct BenchConfig {
+    int depth = 1000;
+    int num_commodities = 6;
+    int iterations = 200;
+    std::string distribution = "uniform";
+    int num_traders = 100;
+    int resolve_workers = -1;
+    int warmup = 20;
+    double mid_price = 10;
+};
+
+// Draws bid and ask prices around the mid price. "crossed" makes every bid cross every ask (worst case for the
+// match loop), "disjoint" makes none cross (sort and validate only).
+class PriceGenerator {
+private:
+    std::string distribution;
+    double mid;
+    std::uniform_real_distribution<> uniform{0.8, 1.2};
+    std::normal_distribution<> normal{1.0, 0.05};
+    std::uniform_real_distribution<> upper{1.0, 1.2};
+    std::uniform_real_distribution<> lower{0.8, 1.0};
+public:
+    PriceGenerator(std::string distribution, double mid)
+        : distribution(std::move(distribution))
+        , mid(mid) {};
+
+    bool Valid() const {
+        return distribution == "uniform" || distribution == "normal" || distribution == "crossed" || distribution == "disjoint";
+    }
+    double Bid(std::mt19937& gen) {
+        if (distribution == "normal") return mid*normal(gen);
+        if (distribution == "crossed") return mid*upper(gen);
+        if (distribution == "disjoint") return mid*lower(gen);
+        return mid*uniform(gen);
+    }
+    double Ask(std::mt19937& gen) {
+        if (distribution == "normal") return mid*normal(gen);
+        if (distribution == "crossed") return mid*lower(gen);
+        if (distribution == "disjoint") return mid*upper(gen);
+        return mid*uniform(gen);
+    }
+};
+
+void FillBooks(AuctionHouse& auction_house, const BenchConfig& config, const std::vector<std::string>& commodities,
+               PriceGenerator& prices, std::mt19937& gen) {
+    std::uniform_int_distribution<> random_trader(1, config.num_traders);
+    std::uniform_int_distribution<> random_quantity(1, 10);
+    for (auto& commodity : commodities) {
+        for (int i = 0; i < config.depth; i++) {
+            int bidder = random_trader(gen);
+            auto bid = Message(bidder);
+            bid.AddBidOffer(BidOffer(bidder, commodity, random_quantity(gen), prices.Bid(gen)));
+            auction_house.ProcessBid(bid);
+
+            int seller = random_trader(gen);
+            auto ask = Message(seller);
+            ask.AddAskOffer(AskOffer(seller, commodity, random_quantity(gen), prices.Ask(gen)));
+            auction_house.ProcessAsk(ask);
+        }
+    }
+}
+
+// Deliver the tick's results to the stub traders (who discard them) so queues don't grow between iterations
+void DrainResults(AuctionHouse& auction_house, std::vector<std::shared_ptr<FakeTrader>>& traders) {
+    while (auction_house.OutboxSize() > 0) {
+        auction_house.FlushOutbox();
+    }
+    for (auto& trader : traders) {
+        trader->FlushInbox();
+    }
+}
+
+int RunBench(const BenchConfig& config) {
+    std::filesystem::create_directories("logs");
+    PriceGenerator prices(config.distribution, config.mid_price);
+    if (!prices.Valid()) {
+        std::cout << "Error: Unknown price distribution '" << config.distribution << "'" << std::endl;
+        return 1;
+    }
+    std::mt19937 gen(42);
+
+    auto auction_house = std::make_shared<AuctionHouse>(0, Log::ERROR, config.resolve_workers);
+    // Drive the AH from this thread only, so nothing else touches the books (or allocates) while we measure
+    auction_house->ShutdownMessageThread();
+
+    std::vector<std::string> commodities;
+    for (int i = 0; i < config.num_commodities; i++) {
+        commodities.push_back("commodity" + std::to_string(i));
+        auction_house->RegisterCommodity(Commodity(commodities.back(), 1));
+    }
+
+    std::vector<std::shared_ptr<FakeTrader>> traders;
+    for (int trader_id = 1; trader_id <= config.num_traders; trader_id++) {
+        traders.push_back(std::make_shared<FakeTrader>(trader_id, auction_house));
+        auto request = Message(trader_id);
+        request.AddRegisterRequest(RegisterRequest(trader_id, traders.back()));
+        auction_house->ProcessRegistrationRequest(request);
+    }
+    DrainResults(*auction_house, traders);
+
+    LatencyHistogram tick_time("TickOnce");
+    std::uint64_t total_allocations = 0;
+    std::uint64_t late_allocations = 0;    // over the last quarter, once buffers and pools have reached their peak size
+    int late_start = config.warmup + config.iterations - config.iterations/4;
+    double total_fills = 0;
+    for (int i = 0; i < config.warmup + config.iterations; i++) {
+        bool timed = (i >= config.warmup);
+        if (i == config.warmup) {
+            auction_house->timings.Reset();
+        }
+        FillBooks(*auction_house, config, commodities, prices, gen);
+
+        auto allocations_before = num_allocations.load(std::memory_order_relaxed);
+        auto t1 = std::chrono::steady_clock::now();
+        auction_house->TickOnce();
+        auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t1).count();
+        auto allocations = num_allocations.load(std::memory_order_relaxed) - allocations_before;
+
+        if (timed) {
+            tick_time.Record(elapsed_ns);
+            total_allocations += allocations;
+            if (i >= late_start) {
+                late_allocations += allocations;
+            }
+            for (auto& commodity : commodities) {
+                total_fills += auction_house->AverageHistoricalTrades(commodity, 1);
+            }
+        }
+        DrainResults(*auction_house, traders);
+    }
+
+    double orders_per_tick = 2.0*config.depth*config.num_commodities;
+    double total_s = tick_time.Mean()*tick_time.Count()/1e9;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "depth=" << config.depth << " commodities=" << config.num_commodities
+              << " traders=" << config.num_traders << " distribution=" << config.distribution
+              << " iterations=" << config.iterations << "\n";
+    std::cout << tick_time.Summary() << "\n";
+    std::cout << "ns/order:      " << tick_time.Mean()/orders_per_tick << "\n";
+    std::cout << "fills/tick:    " << total_fills/config.iterations << "\n";
+    std::cout << "fills/s:       " << ((total_s > 0) ? total_fills/total_s : 0) << "\n";
+    std::cout << "allocs/tick:   " << (double) total_allocations/config.iterations
+              << " (last quarter " << ((config.iterations/4 > 0) ? (double) late_allocations/(config.iterations/4) : 0) << ")\n";
+    std::cout << "\nPhase timings:\n" << auction_house->timings.Summary() << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    if (argc > 1) config.depth = std::stoi(std::string(argv[1]));
+    if (argc > 2) config.num_commodities = std::stoi(std::string(argv[2]));
+    if (argc > 3) config.iterations = std::stoi(std::string(argv[3]));
+    if (argc > 4) config.distribution = std::string(argv[4]);
+    if (argc > 5) config.num_traders = std::stoi(std::string(argv[5]));
+    if (argc > 6) config.resolve_workers = std::stoi(std::string(argv[6]));
+    return RunBench(config);
+}
@@ -0,0 +1,347 @@
+//
+// Created by henry on 18/10/2026.
+//
+// Scaling harness: runs the full simulation (AH + AI traders, no display) at a series of trader counts with a fixed
+// seed, then binary-searches the largest trader count whose AH p99 tick time stays within the deadline.
+// Each run happens in a forked child, so measurements (RSS, CPU) are per-run and a run that exhausts threads or
+// memory is reported as failed rather than taking the harness down with it.
+//
+// Usage: scaling_bench [duration_s] [trader_counts] [deadline_ms] [report_path] [trader_tps]
+//   duration_s      measured seconds per run (default 10)
+//   trader_counts   comma separated (default 100,1000,10000,100000)
+//   deadline_ms     AH tick deadline for the capacity search, <= 0 to skip the search (default 10)
+//   report_path     JSON report (default scaling_report.json)
+//   trader_tps      trader ticks per second (default 5)
+//
+#include "../outerspatial_engine.h"
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct ScalingConfig {
+    double duration_s = 10;
+    std::vector<int> trader_counts = {100, 1000, 10000, 100000};
+    double deadline_ms = 10;
+    std::string report_path = "scaling_report.json";
+    double trader_tps = 5;
+    unsigned int seed = 42;
+    double search_tolerance = 0.05;     // stop once the bracket is within 5%
+
+    // Spawning can take far longer than the measured window once the machine is saturated
+    double RunTimeoutSeconds() const {
+        return 5*duration_s + 60;
+    }
+};
+
+struct ScalingResult {
+    int num_traders = 0;
+    bool ok = false;
+    std::string failure;
+
+    double startup_s = 0;           // building and registering the starting population
+    double duration_s = 0;
+    std::uint64_t ah_ticks = 0;
+    std::uint64_t ah_overruns = 0;
+    double tick_p50_ms = 0;
+    double tick_p99_ms = 0;
+    double tick_max_ms = 0;
+    double messages_per_s = 0;
+    std::uint64_t trader_ticks = 0;
+    double cpu_s = 0;
+    double cpu_us_per_trader_tick = 0;
+    double peak_rss_mb = 0;
+
+    bool HoldsDeadline(double deadline_ms) const {
+        return ok && tick_p99_ms <= deadline_ms;
+    }
+
+    std::string ToJson() const {
+        std::ostringstream out;
+        out << "{\"traders\":" << num_traders << ",\"ok\":" << (ok ? "true" : "false");
+        if (!ok) {
+            out << ",\"failure\":\"" << failure << "\"}";
+            return out.str();
+        }
+        out << ",\"startup_s\":" << startup_s
+            << ",\"duration_s\":" << duration_s
+            << ",\"ah_ticks\":" << ah_ticks
+            << ",\"ah_overruns\":" << ah_overruns
+            << ",\"overrun_rate\":" << ((ah_ticks > 0) ? (double) ah_overruns/ah_ticks : 0)
+            << ",\"tick_p50_ms\":" << tick_p50_ms
+            << ",\"tick_p99_ms\":" << tick_p99_ms
+            << ",\"tick_max_ms\":" << tick_max_ms
+            << ",\"messages_per_s\":" << messages_per_s
+            << ",\"trader_ticks\":" << trader_ticks
+            << ",\"cpu_s\":" << cpu_s
+            << ",\"cpu_us_per_trader_tick\":" << cpu_us_per_trader_tick
+            << ",\"peak_rss_mb\":" << peak_rss_mb << "}";
+        return out.str();
+    }
+};
+
+double ReadStatusMb(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind(field + ":", 0) == 0) {
+            return std::stod(line.substr(field.size() + 1)) / 1024;   // reported in kB
+        }
+    }
+    return 0;
+}
+
+double CpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+}
+
+// Runs one simulation in the current process. Traders are kept at num_traders by replacing the ones that die, as
+// the driver does: through a TraderPool, which recycles dead traders' slots into their replacements.
+ScalingResult RunSimulation(int num_traders, const ScalingConfig& config) {
+    int TRADER_TICK_TIME_MS = (int) (1000/config.trader_tps);
+    int TARGET_STEPTIME_MS = 10;
+
+    Rng::SetGlobalSeed(config.seed);
+    Rng gen = Rng::Stream(Rng::DRIVER_STREAM);
+    auto& economy = Economy::Default();
+
+    int max_id = 0;
+    auto auction_house = std::make_shared<AuctionHouse>(max_id, Log::SILENT);
+    max_id++;
+    for (auto& commodity : economy.commodities) {
+        auction_house->RegisterCommodity(commodity);
+    }
+    int ah_duration_ms = (int) (config.duration_s*1000) + 3600*1000;  // shut down manually
+    std::thread auction_house_thread(&AuctionHouse::Tick, auction_house, ah_duration_ms);
+
+    TraderPool trader_pool(auction_house, TRADER_TICK_TIME_MS, Log::SILENT);
+    // The starting population is registered in one go, which keeps startup quick at large trader counts
+    std::vector<int> starting_roles;
+    for (int i = 0; i < num_traders; i++) {
+        starting_roles.push_back(i % (int) economy.roles.size());
+    }
+    auto startup_start = std::chrono::steady_clock::now();
+    MakeAgents(economy, starting_roles, max_id, trader_pool, gen);
+    double startup_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - startup_start).count();
+
+    // Only measure the steady state
+    auction_house->timings.Reset();
+    auto ticks_before = auction_house->counters.ticks.load();
+    auto overruns_before = auction_house->counters.overruns.load();
+    auto messages_before = auction_house->counters.messages_received.load() + auction_house->counters.messages_sent.load();
+    auto trader_ticks_before = AITrader::timings.tick.Count();
+    double cpu_before = CpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+
+    int duration_ms = (int) (config.duration_s*1000);
+    int elapsed = 0;
+    while (elapsed < duration_ms) {
+        auto t1 = std::chrono::steady_clock::now();
+        // Count the pool's live traders rather than asking the AH, whose count lags behind pending registrations and
+        // would make us over-spawn at high trader counts
+        int current_traders = trader_pool.NumAlive();
+        if (current_traders < num_traders) {
+            std::vector<int> new_roles;
+            for (int i = current_traders; i < num_traders; i++) {
+                auto new_role = ChooseNewClassWeighted(economy, auction_house, gen);
+                if (new_role >= 0) {
+                    new_roles.push_back(new_role);
+                }
+            }
+            MakeAgents(economy, new_roles, max_id, trader_pool, gen);
+        }
+        auto work_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
+        if (work_ms < TARGET_STEPTIME_MS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{TARGET_STEPTIME_MS - work_ms});
+        }
+        elapsed = (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ScalingResult result;
+    result.num_traders = num_traders;
+    result.ok = true;
+    result.startup_s = startup_s;
+    result.duration_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.ah_ticks = auction_house->counters.ticks.load() - ticks_before;
+    result.ah_overruns = auction_house->counters.overruns.load() - overruns_before;
+    result.tick_p50_ms = auction_house->timings.tick.Percentile(0.5) / 1e6;
+    result.tick_p99_ms = auction_house->timings.tick.Percentile(0.99) / 1e6;
+    result.tick_max_ms = auction_house->timings.tick.Max() / 1e6;
+    auto messages = auction_house->counters.messages_received.load() + auction_house->counters.messages_sent.load() - messages_before;
+    result.messages_per_s = messages / result.duration_s;
+    result.trader_ticks = AITrader::timings.tick.Count() - trader_ticks_before;
+    result.cpu_s = CpuSeconds() - cpu_before;
+    result.cpu_us_per_trader_tick = (result.trader_ticks > 0) ? result.cpu_s*1e6/result.trader_ticks : 0;
+    result.peak_rss_mb = ReadStatusMb("VmHWM");
+
+    auction_house->Shutdown();
+    auction_house_thread.join();
+    trader_pool.Shutdown();
+    return result;
+}
+
+// Forks, runs the simulation in the child and reads its result back over a pipe
+ScalingResult RunIsolated(int num_traders, const ScalingConfig& config) {
+    std::cout << "Running " << num_traders << " traders for " << config.duration_s << "s..." << std::flush;
+    ScalingResult failed;
+    failed.num_traders = num_traders;
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        failed.failure = "pipe() failed";
+        return failed;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        failed.failure = "fork() failed";
+        return failed;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        auto json = RunSimulation(num_traders, config).ToJson();
+        auto written = write(fds[1], json.c_str(), json.size());
+        close(fds[1]);
+        // Skip tearing down thousands of traders
+        _exit(written == (ssize_t) json.size() ? 0 : 1);
+    }
+
+    close(fds[1]);
+    int status = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(config.RunTimeoutSeconds());
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            close(fds[0]);
+            failed.failure = "timed out after " + std::to_string((int) config.RunTimeoutSeconds()) + "s";
+            std::cout << " FAILED (" << failed.failure << ")" << std::endl;
+            return failed;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+    // The child has exited, so its result (if any) is sitting in the pipe buffer
+    std::string json;
+    char buffer[512];
+    ssize_t num_read;
+    while ((num_read = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        json.append(buffer, num_read);
+    }
+    close(fds[0]);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || json.empty()) {
+        failed.failure = WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status))
+                                             : "exited with status " + std::to_string(WEXITSTATUS(status));
+        std::cout << " FAILED (" << failed.failure << ")" << std::endl;
+        return failed;
+    }
+    // The child already formatted the JSON; pull out the fields we need for the search and the console summary
+    ScalingResult result;
+    result.num_traders = num_traders;
+    result.ok = true;
+    auto field = [&json] (const std::string& name) {
+        auto pos = json.find("\"" + name + "\":");
+        return (pos == std::string::npos) ? 0.0 : std::stod(json.substr(pos + name.size() + 3));
+    };
+    result.startup_s = field("startup_s");
+    result.duration_s = field("duration_s");
+    result.ah_ticks = (std::uint64_t) field("ah_ticks");
+    result.ah_overruns = (std::uint64_t) field("ah_overruns");
+    result.tick_p50_ms = field("tick_p50_ms");
+    result.tick_p99_ms = field("tick_p99_ms");
+    result.tick_max_ms = field("tick_max_ms");
+    result.messages_per_s = field("messages_per_s");
+    result.trader_ticks = (std::uint64_t) field("trader_ticks");
+    result.cpu_s = field("cpu_s");
+    result.cpu_us_per_trader_tick = field("cpu_us_per_trader_tick");
+    result.peak_rss_mb = field("peak_rss_mb");
+    std::cout << " startup " << result.startup_s << "s, tick p99=" << result.tick_p99_ms << "ms, overruns=" << result.ah_overruns << "/" << result.ah_ticks
+              << ", " << result.messages_per_s << " msg/s, " << result.cpu_us_per_trader_tick << "us CPU/trader-tick, "
+              << result.peak_rss_mb << "MB peak RSS" << std::endl;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    ScalingConfig config;
+    if (argc > 1) config.duration_s = std::stod(std::string(argv[1]));
+    if (argc > 2) {
+        config.trader_counts.clear();
+        std::stringstream counts(argv[2]);
+        std::string count;
+        while (std::getline(counts, count, ',')) {
+            config.trader_counts.push_back(std::stoi(count));
+        }
+        std::sort(config.trader_counts.begin(), config.trader_counts.end());
+    }
+    if (argc > 3) config.deadline_ms = std::stod(std::string(argv[3]));
+    if (argc > 4) config.report_path = std::string(argv[4]);
+    if (argc > 5) config.trader_tps = std::stod(std::string(argv[5]));
+
+    std::filesystem::create_directories("logs");
+    // Each trader holds a couple of threads and, unless silent, a log file
+    rlimit files{};
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    std::vector<ScalingResult> sweep;
+    int largest_passing = 0;
+    int smallest_failing = 0;
+    for (int count : config.trader_counts) {
+        sweep.push_back(RunIsolated(count, config));
+        if (sweep.back().HoldsDeadline(config.deadline_ms)) {
+            largest_passing = std::max(largest_passing, count);
+        } else if (smallest_failing == 0) {
+            smallest_failing = count;
+        }
+    }
+
+    // Binary search between the largest passing and smallest failing sweep points
+    std::vector<ScalingResult> search;
+    int capacity = largest_passing;
+    bool searched = config.deadline_ms > 0 && smallest_failing > largest_passing;
+    if (searched) {
+        int low = (largest_passing > 0) ? largest_passing : 1;
+        int high = smallest_failing;
+        std::cout << "Searching for capacity at " << config.deadline_ms << "ms p99 tick deadline in [" << low << ", " << high << ")" << std::endl;
+        while (high - low > std::max(1, (int) (low*config.search_tolerance))) {
+            int mid = low + (high - low)/2;
+            search.push_back(RunIsolated(mid, config));
+            if (search.back().HoldsDeadline(config.deadline_ms)) {
+                low = mid;
+                capacity = mid;
+            } else {
+                high = mid;
+            }
+        }
+    }
+
+    std::ofstream report(config.report_path);
+    report << "{\n  \"seed\": " << config.seed
+           << ",\n  \"duration_s\": " << config.duration_s
+           << ",\n  \"trader_tps\": " << config.trader_tps
+           << ",\n  \"deadline_ms\": " << config.deadline_ms
+           << ",\n  \"sweep\": [";
+    for (std::size_t i = 0; i < sweep.size(); i++) {
+        report << (i ? ",\n    " : "\n    ") << sweep[i].ToJson();
+    }
+    report << "\n  ],\n  \"search\": [";
+    for (std::size_t i = 0; i < search.size(); i++) {
+        report << (i ? ",\n    " : "\n    ") << search[i].ToJson();
+    }
+    report << "\n  ],\n  \"max_traders_within_deadline\": " << capacity
+           << ",\n  \"capacity_is_lower_bound\": " << ((smallest_failing == 0) ? "true" : "false") << "\n}\n";
+    report.close();
+
+    std::cout << "Largest trader count holding a " << config.deadline_ms << "ms p99 tick: " << capacity
+              << ((smallest_failing == 0) ? " (no tested count failed)" : "") << std::endl;
+    std::cout << "Wrote report to " << config.report_path << std::endl;
+    return 0;
+}
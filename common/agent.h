@@ -7,6 +7,7 @@
 
 #include "messages.h"
 #include <memory>
+#include <mutex>
 #include <utility>
 
 class AuctionHouse;
@@ -21,12 +22,18 @@ public:
     int ticks = 0;
     Agent(int agent_id) : id(agent_id) {};
     virtual ~Agent() = default;
-    void ReceiveMessage(const Message incoming_message) {
-        inbox.push(incoming_message);
+    void ReceiveMessage(Message incoming_message) {
+        inbox.push(std::move(incoming_message));
     }
     void SendMessage(Message outgoing_message, int recipient) {
         outbox.push({recipient,std::move(outgoing_message)});
     }
+    unsigned long InboxSize() const {
+        return inbox.size();
+    }
+    unsigned long OutboxSize() const {
+        return outbox.size();
+    }
 };
 
 // A Trader is an Agent capable of interacting with an AuctionHouse
@@ -44,6 +51,9 @@ public:
 protected:
     friend AuctionHouse;
     std::string class_name;
+    // Held by the auction house while it settles a trade or fee with this trader, since several commodities may be
+    // resolving at once
+    std::mutex settlement_mutex;
     virtual double TryTakeMoney(double quantity, bool atomic) { return 0.0;};
     virtual void ForceTakeMoney(double quantity) {};
     virtual void AddMoney(double quantity) {};
@@ -0,0 +1,167 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_CHECKPOINT_H
+#define CPPBAZAARBOT_CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ring_buffer.h"
+
+// Binary checkpoint files, written and read in a single sequential pass through a large stream buffer.
+// Values are stored in native byte order and layout, so a checkpoint is only meant to be read back by the same build
+// on the same kind of machine. Each part of the state starts with a section tag, so a truncated or mismatched file
+// is caught where it goes wrong rather than read as garbage.
+namespace Checkpoint {
+    constexpr char MAGIC[8] = {'O', 'S', 'E', 'C', 'K', 'P', 'T', '\0'};
+    constexpr std::uint32_t VERSION = 2;
+    constexpr std::size_t BUFFER_SIZE = 1 << 20;
+
+    // Section tags
+    constexpr std::uint32_t AUCTION_HOUSE = 0x41484F55;     // "AHOU"
+    constexpr std::uint32_t HISTORY = 0x48495354;           // "HIST"
+    constexpr std::uint32_t BOOKS = 0x424F4F4B;             // "BOOK"
+    constexpr std::uint32_t TRADERS = 0x54524453;           // "TRDS"
+    constexpr std::uint32_t END = 0x454E4421;               // "END!"
+}
+
+class CheckpointWriter {
+private:
+    std::vector<char> buffer;
+    std::ofstream file;
+
+public:
+    explicit CheckpointWriter(const std::string& path)
+        : buffer(Checkpoint::BUFFER_SIZE) {
+        file.rdbuf()->pubsetbuf(buffer.data(), (std::streamsize) buffer.size());
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (file) {
+            file.write(Checkpoint::MAGIC, sizeof(Checkpoint::MAGIC));
+            Write(Checkpoint::VERSION);
+        }
+    }
+
+    bool ok() const { return (bool) file; }
+
+    // Flushes everything written so far; false if anything failed along the way
+    bool Finish() {
+        Section(Checkpoint::END);
+        file.flush();
+        return ok();
+    }
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written directly");
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void WriteString(const std::string& value) {
+        Write((std::uint32_t) value.size());
+        file.write(value.data(), (std::streamsize) value.size());
+    }
+    void Section(std::uint32_t tag) {
+        Write(tag);
+    }
+
+    // Oldest first. T is written field by field via write_item(*this, item).
+    template <typename T, typename F>
+    void WriteRing(const RingBuffer<T>& ring, F write_item) {
+        Write((std::uint64_t) ring.capacity());
+        Write((std::uint64_t) ring.size());
+        for (std::size_t i = 0; i < ring.size(); i++) {
+            write_item(*this, ring[i]);
+        }
+    }
+};
+
+class CheckpointReader {
+private:
+    std::vector<char> buffer;
+    std::ifstream file;
+    std::string path;
+    bool failed = false;
+
+public:
+    explicit CheckpointReader(const std::string& path)
+        : buffer(Checkpoint::BUFFER_SIZE)
+        , path(path) {
+        file.rdbuf()->pubsetbuf(buffer.data(), (std::streamsize) buffer.size());
+        file.open(path, std::ios::binary);
+        if (!file) {
+            Fail("failed to open");
+            return;
+        }
+        char magic[sizeof(Checkpoint::MAGIC)];
+        file.read(magic, sizeof(magic));
+        if (!file || std::memcmp(magic, Checkpoint::MAGIC, sizeof(magic)) != 0) {
+            Fail("not a checkpoint");
+            return;
+        }
+        if (Read<std::uint32_t>() != Checkpoint::VERSION) {
+            Fail("unsupported checkpoint version");
+        }
+    }
+
+    bool ok() const { return !failed; }
+
+    // Reports the first failure only, and makes every later read a no-op
+    bool Fail(const std::string& message) {
+        if (!failed) {
+            std::cout << "Error: Checkpoint " << path << ": " << message << std::endl;
+            failed = true;
+        }
+        return false;
+    }
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read directly");
+        T value{};
+        if (!failed && !file.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+            Fail("unexpected end of file");
+        }
+        return value;
+    }
+    std::string ReadString() {
+        auto size = Read<std::uint32_t>();
+        std::string value;
+        if (!failed) {
+            value.resize(size);
+            if (!file.read(value.data(), size)) {
+                Fail("unexpected end of file");
+            }
+        }
+        return value;
+    }
+    bool Section(std::uint32_t tag, const char* name) {
+        if (!failed && Read<std::uint32_t>() != tag) {
+            return Fail(std::string("expected ") + name + " section");
+        }
+        return ok();
+    }
+
+    // Replaces ring's contents (and capacity) with those written by WriteRing, reading each item with
+    // read_item(*this). Storage is grown as items arrive rather than allocated up front.
+    template <typename T, typename F>
+    void ReadRing(RingBuffer<T>& ring, F read_item) {
+        auto capacity = Read<std::uint64_t>();
+        auto size = Read<std::uint64_t>();
+        if (failed || size > capacity) {
+            Fail("corrupt ring buffer");
+            return;
+        }
+        ring.set_capacity(capacity, false);
+        for (std::uint64_t i = 0; i < size && !failed; i++) {
+            ring.push_back(read_item(*this));
+        }
+    }
+};
+
+#endif//CPPBAZAARBOT_CHECKPOINT_H
@@ -4,24 +4,43 @@
 
 #ifndef CPPBAZAARBOT_CONCURRENCY_H
 #define CPPBAZAARBOT_CONCURRENCY_H
+#include <algorithm>
 #include <optional>
 #include <thread>
-#include <queue>
 #include <mutex>
+#include <vector>
 
 std::int64_t to_unix_timestamp_ms(const std::chrono::system_clock::time_point& time) {
     return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
 }
 
+// Monotonic timestamp, only meaningful relative to other calls within the same process
+std::int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Mutex-guarded FIFO on a ring of slots. The ring doubles when full and never shrinks, so once a queue has seen its
+// peak depth, pushing and popping no longer allocate. Items are moved in and out rather than copied.
 template<typename T>
 class SafeQueue {
-    std::queue<T> queue_;
+    std::vector<std::optional<T>> slots_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
     mutable std::mutex mutex_;
 
     // Moved out of public interface to prevent races between this
     // and pop().
     bool empty() const {
-        return queue_.empty();
+        return count_ == 0;
+    }
+
+    void Grow() {
+        std::vector<std::optional<T>> grown(std::max<std::size_t>(16, 2*slots_.size()));
+        for (std::size_t i = 0; i < count_; i++) {
+            grown[i] = std::move(slots_[(head_ + i) % slots_.size()]);
+        }
+        slots_.swap(grown);
+        head_ = 0;
     }
 
 public:
@@ -30,30 +49,81 @@ public:
     SafeQueue& operator=(const SafeQueue<T> &) = delete ;
 
     SafeQueue(SafeQueue<T>&& other) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_ = std::move(other.queue_);
+        std::lock_guard<std::mutex> lock(other.mutex_);
+        slots_ = std::move(other.slots_);
+        head_ = other.head_;
+        count_ = other.count_;
+        other.head_ = 0;
+        other.count_ = 0;
     }
 
     virtual ~SafeQueue() { }
 
     unsigned long size() const {
         std::lock_guard<std::mutex> lock(mutex_);
-        return queue_.size();
+        return count_;
     }
 
     std::optional<T> pop() {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (queue_.empty()) {
+        if (empty()) {
             return {};
         }
-        T tmp = queue_.front();
-        queue_.pop();
+        auto& slot = slots_[head_];
+        std::optional<T> tmp = std::move(slot);
+        slot.reset();
+        head_ = (head_ + 1 == slots_.size()) ? 0 : head_ + 1;
+        count_--;
         return tmp;
     }
 
-    void push(const T &item) {
+    void push(T item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == slots_.size()) {
+            Grow();
+        }
+        slots_[(head_ + count_) % slots_.size()] = std::move(item);
+        count_++;
+    }
+
+    // Bounded push: item is only moved from if the queue held fewer than max_size items
+    bool try_push(T& item, std::size_t max_size) {
         std::lock_guard<std::mutex> lock(mutex_);
-        queue_.push(item);
+        if (count_ >= max_size) {
+            return false;
+        }
+        if (count_ == slots_.size()) {
+            Grow();
+        }
+        slots_[(head_ + count_) % slots_.size()] = std::move(item);
+        count_++;
+        return true;
+    }
+
+    // Puts an item back at the head, eg one that was popped but couldn't be delivered
+    void push_front(T item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == slots_.size()) {
+            Grow();
+        }
+        head_ = (head_ == 0) ? slots_.size() - 1 : head_ - 1;
+        slots_[head_] = std::move(item);
+        count_++;
+    }
+
+    // Overwrites the newest queued item for which match(queued) holds with item, in place. False (and item untouched)
+    // if there is none, in which case it's up to the caller to push it.
+    template<typename Match>
+    bool coalesce(T& item, Match match) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = count_; i-- > 0;) {
+            auto& slot = slots_[(head_ + i) % slots_.size()];
+            if (match(*slot)) {
+                slot = std::move(item);
+                return true;
+            }
+        }
+        return false;
     }
 };
 #endif//CPPBAZAARBOT_CONCURRENCY_H
@@ -0,0 +1,375 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_ECONOMY_H
+#define CPPBAZAARBOT_ECONOMY_H
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "commodity.h"
+#include "../traders/inventory.h"
+#include "../traders/recipes.h"
+
+// Economy definition format. One directive per line, '#' starts a comment, and names are single words.
+//
+//   commodity <name> <size>
+//   role <name>                            starts a role; the lines below describe it, up to the next role
+//     produces <commodity>                 new traders of this role are spawned when <commodity> is scarce
+//     inventory <commodity> <start> <ideal>
+//     fulfillment_floor <share>            bids are sized as if at least <share> of each ideal stock were held
+//     rule [when <condition>...] do <step>[, <step>...] [stop]
+//
+// A condition is a commodity name (holds at least one) or !name (holds none). A step is one of
+//   idle_tax [@chance]
+//   consume <commodity> <amount> [@chance]
+//   produce <commodity> <amount> [@chance]
+//   convert <commodity> <max|all> <output> [@chance]
+// and "stop" ends the tick once that rule has fired. See RecipeStep for exactly what each step does.
+// Commodities must be declared before a role refers to them.
+const char* DEFAULT_ECONOMY = R"(
+commodity food 0.5
+commodity wood 1
+commodity fertilizer 0.1
+commodity ore 1
+commodity metal 1
+commodity tools 1
+
+role farmer
+    produces food
+    inventory food 0 0
+    inventory tools 1 2
+    inventory wood 1 6
+    inventory fertilizer 1 6
+    rule when !fertilizer do idle_tax stop
+    rule do consume fertilizer 1
+    # 10% chance tools break
+    rule when tools wood do consume tools 1 @0.1, consume wood 1, produce food 6 stop
+    rule when wood do consume wood 1, produce food 3 stop
+    rule do produce food 1 stop
+
+role woodcutter
+    produces wood
+    inventory food 1 6
+    inventory tools 1 2
+    inventory wood 0 0
+    rule when !food do idle_tax stop
+    rule when tools do consume tools 1 @0.1, consume food 1, produce wood 2 stop
+    rule do consume food 1, produce wood 1 stop
+
+role composter
+    produces fertilizer
+    inventory food 1 6
+    inventory fertilizer 0 0
+    rule when !food do idle_tax stop
+    rule do consume food 1, produce fertilizer 1 @0.5 stop
+
+role miner
+    produces ore
+    inventory food 1 6
+    inventory tools 1 2
+    inventory ore 0 0
+    rule when !food do idle_tax
+    rule do consume food 1
+    rule when tools do consume tools 1 @0.1, produce ore 4 stop
+    rule do produce ore 2 stop
+
+role refiner
+    produces metal
+    fulfillment_floor 0.5
+    inventory food 1 6
+    inventory tools 1 2
+    inventory ore 1 10
+    inventory metal 0 0
+    rule when !food do idle_tax
+    rule do consume food 1
+    rule when tools do consume tools 1 @0.1, convert ore all metal stop
+    # convert up to 2 ore into metal if no tools
+    rule do convert ore 2 metal stop
+
+role blacksmith
+    produces tools
+    fulfillment_floor 0.5
+    inventory food 1 6
+    inventory tools 0 0
+    inventory metal 0 10
+    rule when !food do idle_tax
+    rule do consume food 1
+    rule when metal do convert metal all tools stop
+)";
+
+struct RoleDefinition {
+    std::string name;
+    std::vector<InventoryItem> inventory;                   // starting inventory of a new trader
+    std::shared_ptr<const RecipeProgram> program;
+    double fulfillment_floor = 0;                           // see Role::fulfillment_floor
+};
+
+// Everything that defines an economy, parsed once and held as tables indexed by commodity id and role id (positions
+// in commodities and roles, in the order the file declares them). Read-only once loaded, so safe to share.
+class Economy {
+public:
+    std::vector<Commodity> commodities;
+    std::vector<RoleDefinition> roles;
+    std::vector<int> producer;                              // commodity id -> id of the role that makes it, or -1
+
+private:
+    std::unordered_map<std::string, int> commodity_ids;
+    std::unordered_map<std::string, int> role_ids;
+
+    struct ParseError {
+        std::string source;
+        int line;
+
+        std::nullopt_t operator()(const std::string& message) const {
+            std::cout << "Error: " << source << ":" << line << ": " << message << std::endl;
+            return std::nullopt;
+        }
+    };
+
+    // Splits on whitespace, with commas as tokens of their own
+    static std::vector<std::string> Tokenize(const std::string& line) {
+        std::vector<std::string> tokens;
+        std::string current;
+        for (char c : line.substr(0, line.find('#'))) {
+            if (std::isspace((unsigned char) c) || c == ',') {
+                if (!current.empty()) {
+                    tokens.push_back(current);
+                    current.clear();
+                }
+                if (c == ',') {
+                    tokens.emplace_back(",");
+                }
+            } else {
+                current += c;
+            }
+        }
+        if (!current.empty()) {
+            tokens.push_back(current);
+        }
+        return tokens;
+    }
+    static std::optional<double> ParseNumber(const std::string& token) {
+        std::istringstream stream(token);
+        double value;
+        if (!(stream >> value) || !stream.eof()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    std::optional<RecipeStep> ParseStep(const std::vector<std::string>& tokens, std::size_t& pos, const ParseError& error) const {
+        RecipeStep step;
+        std::string op = tokens[pos++];
+        std::size_t num_args;
+        if (op == "idle_tax") {
+            step.op = RecipeStep::IDLE_TAX;
+            num_args = 0;
+        } else if (op == "consume" || op == "produce") {
+            step.op = (op == "consume") ? RecipeStep::CONSUME : RecipeStep::PRODUCE;
+            num_args = 2;
+        } else if (op == "convert") {
+            step.op = RecipeStep::CONVERT;
+            num_args = 3;
+        } else {
+            return error("unknown step '" + op + "'");
+        }
+        if (pos + num_args > tokens.size()) {
+            return error("too few arguments to " + op);
+        }
+        if (num_args > 0) {
+            step.commodity = tokens[pos++];
+            if (commodity_ids.count(step.commodity) == 0) {
+                return error("unknown commodity '" + step.commodity + "'");
+            }
+            auto amount = (op == "convert" && tokens[pos] == "all") ? std::optional<double>(0) : ParseNumber(tokens[pos]);
+            if (!amount || *amount < 0) {
+                return error("bad amount '" + tokens[pos] + "' for " + op);
+            }
+            step.amount = (int) *amount;
+            pos++;
+        }
+        if (num_args > 2) {
+            step.output = tokens[pos++];
+            if (commodity_ids.count(step.output) == 0) {
+                return error("unknown commodity '" + step.output + "'");
+            }
+        }
+        if (pos < tokens.size() && tokens[pos][0] == '@') {
+            auto chance = ParseNumber(tokens[pos].substr(1));
+            if (!chance || *chance < 0 || *chance > 1) {
+                return error("bad chance '" + tokens[pos] + "'");
+            }
+            step.chance = *chance;
+            pos++;
+        }
+        return step;
+    }
+
+    std::optional<RecipeRule> ParseRule(const std::vector<std::string>& tokens, const ParseError& error) const {
+        RecipeRule rule;
+        std::size_t pos = 1;
+        if (pos < tokens.size() && tokens[pos] == "when") {
+            for (pos++; pos < tokens.size() && tokens[pos] != "do"; pos++) {
+                bool held = (tokens[pos][0] != '!');
+                std::string commodity = held ? tokens[pos] : tokens[pos].substr(1);
+                if (commodity_ids.count(commodity) == 0) {
+                    return error("unknown commodity '" + commodity + "'");
+                }
+                rule.when.push_back({commodity, held});
+            }
+        }
+        if (pos >= tokens.size() || tokens[pos] != "do") {
+            return error("expected 'do'");
+        }
+        pos++;
+        while (pos < tokens.size() && tokens[pos] != "stop") {
+            auto step = ParseStep(tokens, pos, error);
+            if (!step) {
+                return std::nullopt;
+            }
+            rule.steps.push_back(*step);
+            if (pos < tokens.size() && tokens[pos] == ",") {
+                pos++;
+            } else if (pos < tokens.size() && tokens[pos] != "stop") {
+                return error("unexpected '" + tokens[pos] + "'");
+            }
+        }
+        if (pos < tokens.size()) {
+            rule.last = true;
+            pos++;
+        }
+        if (pos < tokens.size()) {
+            return error("unexpected '" + tokens[pos] + "' after stop");
+        }
+        return rule;
+    }
+
+public:
+    // -1 if unknown
+    int CommodityId(const std::string& name) const {
+        auto it = commodity_ids.find(name);
+        return (it == commodity_ids.end()) ? -1 : it->second;
+    }
+    int RoleId(const std::string& name) const {
+        auto it = role_ids.find(name);
+        return (it == role_ids.end()) ? -1 : it->second;
+    }
+
+    std::vector<std::string> CommodityNames() const {
+        std::vector<std::string> names;
+        for (auto& commodity : commodities) {
+            names.push_back(commodity.name);
+        }
+        return names;
+    }
+    std::vector<std::string> RoleNames() const {
+        std::vector<std::string> names;
+        for (auto& role : roles) {
+            names.push_back(role.name);
+        }
+        return names;
+    }
+
+    // source names the input in error messages
+    static std::optional<Economy> Parse(std::istream& input, const std::string& source) {
+        Economy economy;
+        std::vector<Recipe> recipes;
+        std::string line;
+        ParseError error = {source, 0};
+        while (std::getline(input, line)) {
+            error.line++;
+            auto tokens = Tokenize(line);
+            if (tokens.empty()) {
+                continue;
+            }
+            auto& directive = tokens[0];
+            if (directive == "commodity") {
+                auto size = (tokens.size() == 3) ? ParseNumber(tokens[2]) : std::nullopt;
+                if (!size || *size <= 0) {
+                    return error("expected 'commodity <name> <size>'");
+                }
+                if (!economy.commodity_ids.emplace(tokens[1], (int) economy.commodities.size()).second) {
+                    return error("commodity '" + tokens[1] + "' declared twice");
+                }
+                economy.commodities.emplace_back(tokens[1], *size);
+                economy.producer.push_back(-1);
+            } else if (directive == "role") {
+                if (tokens.size() != 2) {
+                    return error("expected 'role <name>'");
+                }
+                if (!economy.role_ids.emplace(tokens[1], (int) economy.roles.size()).second) {
+                    return error("role '" + tokens[1] + "' declared twice");
+                }
+                economy.roles.push_back({tokens[1], {}, nullptr, 0});
+                recipes.push_back({tokens[1], {}});
+            } else if (economy.roles.empty()) {
+                return error("'" + directive + "' outside of a role");
+            } else if (directive == "produces") {
+                int commodity_id = (tokens.size() == 2) ? economy.CommodityId(tokens[1]) : -1;
+                if (commodity_id < 0) {
+                    return error("expected 'produces <commodity>'");
+                }
+                economy.producer[commodity_id] = (int) economy.roles.size() - 1;
+            } else if (directive == "inventory") {
+                int commodity_id = (tokens.size() == 4) ? economy.CommodityId(tokens[1]) : -1;
+                auto start = (tokens.size() == 4) ? ParseNumber(tokens[2]) : std::nullopt;
+                auto ideal = (tokens.size() == 4) ? ParseNumber(tokens[3]) : std::nullopt;
+                if (commodity_id < 0 || !start || !ideal) {
+                    return error("expected 'inventory <commodity> <start> <ideal>'");
+                }
+                economy.roles.back().inventory.emplace_back(economy.commodities[commodity_id], (int) *start, (int) *ideal);
+            } else if (directive == "fulfillment_floor") {
+                auto share = (tokens.size() == 2) ? ParseNumber(tokens[1]) : std::nullopt;
+                if (!share || *share < 0) {
+                    return error("expected 'fulfillment_floor <share>'");
+                }
+                economy.roles.back().fulfillment_floor = *share;
+            } else if (directive == "rule") {
+                auto rule = economy.ParseRule(tokens, error);
+                if (!rule) {
+                    return std::nullopt;
+                }
+                recipes.back().rules.push_back(*rule);
+            } else {
+                return error("unknown directive '" + directive + "'");
+            }
+        }
+        for (std::size_t i = 0; i < recipes.size(); i++) {
+            auto program = RecipeProgram::Compile(recipes[i]);
+            if (!program) {
+                return std::nullopt;
+            }
+            economy.roles[i].program = std::make_shared<const RecipeProgram>(std::move(*program));
+        }
+        return economy;
+    }
+
+    static std::optional<Economy> Load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "Error: Failed to open economy file " << path << std::endl;
+            return std::nullopt;
+        }
+        return Parse(file, path);
+    }
+
+    // DEFAULT_ECONOMY, parsed once
+    static const Economy& Default() {
+        static const Economy economy = [] {
+            std::istringstream input(DEFAULT_ECONOMY);
+            return *Parse(input, "default economy");
+        }();
+        return economy;
+    }
+};
+
+#endif//CPPBAZAARBOT_ECONOMY_H
@@ -8,6 +8,9 @@
 #include <vector>
 #include <atomic>
 
+#include "ring_buffer.h"
+#include "checkpoint.h"
+
 enum LogType {
     PRICE,
     ASK,
@@ -16,11 +19,12 @@ enum LogType {
     NET_SUPPLY
 };
 
+// Each name keeps its most recent max_size values in a ring, so once full, adding a value costs no allocation or copying
 class HistoryLog {
     int max_size = 60000; //10 min worth of data @ 10ms frametime
 public:
     LogType type;
-    std::map<std::string, std::vector<std::pair<double, std::int64_t>>> log;
+    std::map<std::string, RingBuffer<std::pair<double, std::int64_t>>> log;
     std::map<std::string, std::atomic<double>> most_recent;
     HistoryLog(LogType log_type)
     : type(log_type) {
@@ -32,19 +36,20 @@ public:
             return;// already registered
         }
         double starting_value = (type == LogType::PRICE) ? 10 : 0;
-        log[name].emplace_back(starting_value, to_unix_timestamp_ms(std::chrono::system_clock::now()));
+        auto& values = log[name];
+        values.set_capacity(max_size, false);
+        values.push_back({starting_value, to_unix_timestamp_ms(std::chrono::system_clock::now())});
         most_recent[name] = starting_value;
     }
 
+    // Safe to call concurrently for different names (lookups only, no map insertion)
     void add(const std::string& name, double amount) {
-        if (log.count(name) != 1) {
+        auto entry = log.find(name);
+        if (entry == log.end()) {
             return;// no entry found
         }
-        if (log[name].size() == max_size) {
-            log[name].erase(log[name].begin());
-        }
-        log[name].emplace_back(amount, to_unix_timestamp_ms(std::chrono::system_clock::now()));
-        most_recent[name] = amount;
+        entry->second.push_back({amount, to_unix_timestamp_ms(std::chrono::system_clock::now())});
+        most_recent.find(name)->second = amount;
     }
 
     double average(const std::string& name, int range) const {
@@ -67,14 +72,13 @@ public:
         if (log.count(name) != 1) {
             return 0;// no entry found
         }
-        auto start_time = log.at(name).back().second - duration;
+        auto& values = log.at(name);
+        auto start_time = values.back().second - duration;
         double total = 0;
         int range = 0;
-        auto it = log.at(name).rbegin();
-        while (it != log.at(name).rend() && it->second >= start_time) {
-            total += it->first;
+        for (std::size_t i = values.size(); i > 0 && values[i - 1].second >= start_time; i--) {
+            total += values[i - 1].first;
             range++;
-            it++;
         }
         return total/range;
     }
@@ -95,31 +99,68 @@ public:
         if (log.count(name) != 1) {
             return 0;// no entry found
         }
-        auto start_time = log.at(name).back().second - duration;
+        auto& values = log.at(name);
+        auto start_time = values.back().second - duration;
 
-        auto it = log.at(name).rbegin();
-        while (it != log.at(name).rend() && it->second >= start_time) {
-            it++;
+        std::size_t i = values.size();
+        while (i > 0 && values[i - 1].second >= start_time) {
+            i--;
         }
         double prev_value;
-        if (it == log.at(name).rend()) {
-            prev_value = log.at(name).front().first;
+        if (i == 0) {
+            prev_value = values.front().first;
         } else {
-            prev_value = it->first;
+            prev_value = values[i - 1].first;
         }
 
-        double curr_value = log.at(name).back().first;
+        double curr_value = values.back().first;
         return 100*(curr_value- prev_value)/prev_value;
     }
 
+    void Save(CheckpointWriter& out) const {
+        out.Write((std::uint32_t) log.size());
+        for (auto& [name, values] : log) {
+            out.WriteString(name);
+            out.WriteRing(values, [] (CheckpointWriter& out, const std::pair<double, std::int64_t>& entry) {
+                out.Write(entry.first);
+                out.Write(entry.second);
+            });
+            out.Write(most_recent.at(name).load());
+        }
+    }
+    // Only names that have already been initialised are restored. Timestamps are moved on by time_offset_ms, so a
+    // history saved some time ago can pick up where it left off.
+    bool Restore(CheckpointReader& in, std::int64_t time_offset_ms) {
+        auto num_names = in.Read<std::uint32_t>();
+        for (std::uint32_t i = 0; i < num_names && in.ok(); i++) {
+            auto name = in.ReadString();
+            auto entry = log.find(name);
+            RingBuffer<std::pair<double, std::int64_t>> skipped;
+            in.ReadRing((entry != log.end()) ? entry->second : skipped, [time_offset_ms] (CheckpointReader& in) {
+                double value = in.Read<double>();
+                std::int64_t timestamp = in.Read<std::int64_t>();
+                return std::make_pair(value, timestamp + time_offset_ms);
+            });
+            double recent = in.Read<double>();
+            if (entry != log.end()) {
+                if (entry->second.empty()) {
+                    return in.Fail("empty history for " + name);
+                }
+                most_recent.find(name)->second = recent;
+            }
+        }
+        return in.ok();
+    }
+
     std::vector<std::pair<double, double>> get_history(const std::string& name, std::int64_t start_time) {
         std::vector<std::pair<double, double>> output = {};
         if (log.count(name) != 1) {
             return output;// no entry found
         }
-        for (auto& item : log[name]) {
-            if (item.second >= start_time) {
-                output.emplace_back(item.second, item.first);
+        auto& values = log[name];
+        for (std::size_t i = 0; i < values.size(); i++) {
+            if (values[i].second >= start_time) {
+                output.emplace_back(values[i].second, values[i].first);
             }
         }
         return output;
@@ -152,6 +193,24 @@ public:
         trades.initialise(name);
         net_supply.initialise(name);
     }
+
+    void Save(CheckpointWriter& out) const {
+        out.Section(Checkpoint::HISTORY);
+        for (auto* history_log : {&prices, &buy_prices, &asks, &bids, &trades, &net_supply}) {
+            history_log->Save(out);
+        }
+    }
+    bool Restore(CheckpointReader& in, std::int64_t time_offset_ms) {
+        if (!in.Section(Checkpoint::HISTORY, "history")) {
+            return false;
+        }
+        for (auto* history_log : {&prices, &buy_prices, &asks, &bids, &trades, &net_supply}) {
+            if (!history_log->Restore(in, time_offset_ms)) {
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 #endif//CPPBAZAARBOT_HISTORY_H
@@ -8,6 +8,8 @@
 // IWY
 #include "../traders/inventory.h"
 #include "../common/commodity.h"
+#include "../common/price.h"
+#include <limits>
 #include <memory>
 #include <utility>
 
@@ -23,10 +25,27 @@ namespace Msg {
         BID_RESULT,
         ASK_RESULT,
         SHUTDOWN_NOTIFY,
-        SHUTDOWN_COMMAND
+        SHUTDOWN_COMMAND,
+        ORDER_ACK,
+        CANCEL_ORDER,
+        AMEND_ORDER
     };
 }
 
+// Expiry for orders that rest in the book until they are filled or cancelled
+constexpr std::uint64_t GOOD_TILL_CANCELLED = std::numeric_limits<std::uint64_t>::max();
+
+// Monotonic stamps (see monotonic_ns()) taken as an order moves through the system. 0 = stage not reached.
+// Offers carry the stamps up to booking, after which they travel back to the trader on the result.
+struct OrderTimestamps {
+    std::int64_t sent_ns = 0;       // trader queued the offer (SendMessage)
+    std::int64_t arrived_ns = 0;    // offer pushed into the AH inbox
+    std::int64_t booked_ns = 0;     // AH message thread took it from the inbox into the book
+    std::int64_t resolved_ns = 0;   // first ResolveOffers pass that included it
+    std::int64_t filled_ns = 0;     // first (partial) fill
+    std::int64_t closed_ns = 0;     // result queued back to the trader
+};
+
 struct EmptyMessage {
     std::string ToString() const {
         std::string output("Empty message");
@@ -74,22 +93,27 @@ struct RegisterResponse {
     }
 };
 
+// Results report the trades made since the previous result for the same order. Orders that rest across several
+// resolutions get an interim result (closed = false) after each resolution in which they traded, then a final one.
 struct BidResult {
     int sender_id;
     std::string commodity;
+    std::uint64_t order_id = 0;
+    bool closed = true;
     bool broker_fee_paid = false;
     int quantity_untraded = 0;
     int quantity_traded = 0;
     double bought_price = 0;
     double original_price = 0;
+    OrderTimestamps timestamps;
 
     BidResult(int sender_id, std::string commodity, double original_price)
             : sender_id(sender_id)
             , commodity(std::move(commodity))
             , original_price(original_price) {};
 
-    void UpdateWithTrade(int trade_quantity, double unit_price) {
-        bought_price = (bought_price*quantity_traded + unit_price*trade_quantity)/(trade_quantity + quantity_traded);
+    void UpdateWithTrade(int trade_quantity, Price unit_price) {
+        bought_price = (bought_price*quantity_traded + unit_price.ToDouble()*trade_quantity)/(trade_quantity + quantity_traded);
         quantity_traded += trade_quantity;
     }
 
@@ -97,6 +121,12 @@ struct BidResult {
         quantity_untraded += remainder;
     }
 
+    // Starts a new reporting period after an interim result has been sent
+    void ClearTrades() {
+        quantity_traded = 0;
+        bought_price = 0;
+    }
+
     std::string ToString() const {
         std::string output("BID RESULT from ");
         if (quantity_traded > 0) {
@@ -130,17 +160,20 @@ struct BidResult {
 struct AskResult {
     int sender_id;
     std::string commodity;
+    std::uint64_t order_id = 0;
+    bool closed = true;
     bool broker_fee_paid = false;
     int quantity_untraded = 0;
     int quantity_traded = 0;
     double avg_price = 0;
+    OrderTimestamps timestamps;
 
     AskResult(int sender_id, std::string commodity)
             : sender_id(sender_id)
             , commodity(std::move(commodity)) {};
 
-    void UpdateWithTrade(int trade_quantity, double unit_price) {
-        avg_price = (avg_price*quantity_traded + unit_price*trade_quantity)/(trade_quantity + quantity_traded);
+    void UpdateWithTrade(int trade_quantity, Price unit_price) {
+        avg_price = (avg_price*quantity_traded + unit_price.ToDouble()*trade_quantity)/(trade_quantity + quantity_traded);
         quantity_traded += trade_quantity;
     }
 
@@ -148,6 +181,12 @@ struct AskResult {
         quantity_untraded += remainder;
     }
 
+    // Starts a new reporting period after an interim result has been sent
+    void ClearTrades() {
+        quantity_traded = 0;
+        avg_price = 0;
+    }
+
     std::string ToString() const {
         std::string output("ASK RESULT from ");
         if (quantity_traded > 0) {
@@ -179,16 +218,18 @@ struct AskResult {
 };
 
 struct BidOffer {
-    std::uint64_t expiry_ms; //unix time in ns
+    std::uint64_t expiry_ms; //unix time in ms, 0 for an immediate order (lives for a single resolution), or GOOD_TILL_CANCELLED
+    std::uint64_t order_id = 0; //assigned by the auction house on receipt
     int sender_id;
     std::string commodity;
     int quantity;
-    double unit_price;
+    Price unit_price;
+    OrderTimestamps timestamps;
     BidOffer(int sender_id, std::string  commodity_name, int quantity, double unit_price, std::uint64_t expiry_ms = 0)
             : sender_id(sender_id)
             , commodity(std::move(commodity_name))
             , quantity(quantity)
-            , unit_price(unit_price)
+            , unit_price(Price::FromDouble(unit_price))
             , expiry_ms(expiry_ms) {};
 
     std::string ToString() const {
@@ -199,23 +240,25 @@ struct BidOffer {
                 .append(" x")
                 .append(std::to_string(quantity))
                 .append(" @ $")
-                .append(std::to_string(unit_price));
+                .append(unit_price.ToString());
         return output;
     }
 };
 
 struct AskOffer {
-    std::uint64_t expiry_ms; //unix time in ns
+    std::uint64_t expiry_ms; //unix time in ms, 0 for an immediate order (lives for a single resolution), or GOOD_TILL_CANCELLED
+    std::uint64_t order_id = 0; //assigned by the auction house on receipt
     int sender_id;
     std::string commodity;
     int quantity;
-    double unit_price;
+    Price unit_price;
+    OrderTimestamps timestamps;
 
     AskOffer(int sender_id, std::string  commodity_name, int quantity, double unit_price, std::uint64_t expiry_ms = 0)
             : sender_id(sender_id)
             , commodity(std::move(commodity_name))
             , quantity(quantity)
-            , unit_price(unit_price)
+            , unit_price(Price::FromDouble(unit_price))
             , expiry_ms(expiry_ms) {};
 
     std::string ToString() const {
@@ -226,7 +269,7 @@ struct AskOffer {
                 .append(" x")
                 .append(std::to_string(quantity))
                 .append(" @ $")
-                .append(std::to_string(unit_price));
+                .append(unit_price.ToString());
         return output;
     }
 };
@@ -245,6 +288,95 @@ bool operator< (const AskResult& a, const AskResult& b) {
     return a.avg_price > b.avg_price;
 }
 
+// Sent by the auction house when it receives an offer, carrying the id that cancels and amends should refer to.
+// A refused offer (eg for a commodity the auction house doesn't trade) was never booked, and has no id.
+struct OrderAck {
+    int sender_id;
+    std::uint64_t order_id;
+    std::string commodity;
+    bool is_bid;
+    bool refused;
+    OrderAck(int sender_id, std::uint64_t order_id, std::string commodity, bool is_bid, bool refused = false)
+            : sender_id(sender_id)
+            , order_id(order_id)
+            , commodity(std::move(commodity))
+            , is_bid(is_bid)
+            , refused(refused) {};
+
+    std::string ToString() const {
+        std::string output("ORDER ACK from ");
+        output.append(std::to_string(sender_id))
+                .append(": ")
+                .append(is_bid ? "bid #" : "ask #")
+                .append(std::to_string(order_id))
+                .append(" (")
+                .append(commodity)
+                .append(")");
+        if (refused) {
+            output.append(" refused");
+        }
+        return output;
+    }
+};
+
+// Closes a resting order. Its final result reports the cancelled quantity as untraded.
+struct CancelOrder {
+    int sender_id;
+    std::uint64_t order_id;
+    std::string commodity;
+    bool is_bid;
+    CancelOrder(int sender_id, std::uint64_t order_id, std::string commodity, bool is_bid)
+            : sender_id(sender_id)
+            , order_id(order_id)
+            , commodity(std::move(commodity))
+            , is_bid(is_bid) {};
+
+    std::string ToString() const {
+        std::string output("CANCEL from ");
+        output.append(std::to_string(sender_id))
+                .append(": ")
+                .append(is_bid ? "bid #" : "ask #")
+                .append(std::to_string(order_id))
+                .append(" (")
+                .append(commodity)
+                .append(")");
+        return output;
+    }
+};
+
+// Replaces the remaining quantity and price of a resting order. Keeps its time priority unless the price changes
+// or the quantity goes up.
+struct AmendOrder {
+    int sender_id;
+    std::uint64_t order_id;
+    std::string commodity;
+    bool is_bid;
+    int quantity;
+    Price unit_price;
+    AmendOrder(int sender_id, std::uint64_t order_id, std::string commodity, bool is_bid, int quantity, double unit_price)
+            : sender_id(sender_id)
+            , order_id(order_id)
+            , commodity(std::move(commodity))
+            , is_bid(is_bid)
+            , quantity(quantity)
+            , unit_price(Price::FromDouble(unit_price)) {};
+
+    std::string ToString() const {
+        std::string output("AMEND from ");
+        output.append(std::to_string(sender_id))
+                .append(": ")
+                .append(is_bid ? "bid #" : "ask #")
+                .append(std::to_string(order_id))
+                .append(" -> ")
+                .append(commodity)
+                .append(" x")
+                .append(std::to_string(quantity))
+                .append(" @ $")
+                .append(unit_price.ToString());
+        return output;
+    }
+};
+
 struct ShutdownNotify {
     int sender_id;
 
@@ -282,6 +414,9 @@ public:
     std::optional<AskResult> ask_result = std::nullopt;
     std::optional<ShutdownNotify> shutdown_notify = std::nullopt;
     std::optional<ShutdownCommand> shutdown_command = std::nullopt;
+    std::optional<OrderAck> order_ack = std::nullopt;
+    std::optional<CancelOrder> cancel_order = std::nullopt;
+    std::optional<AmendOrder> amend_order = std::nullopt;
 
     Message(int sender_id)
         : sender_id(sender_id)
@@ -355,6 +490,39 @@ public:
         shutdown_command = std::move(msg);
         return this;
     }
+    Message* AddOrderAck(OrderAck msg) {
+        if (type != Msg::EMPTY) {
+            return this; //disallow multiple messages
+        }
+        type = Msg::ORDER_ACK;
+        order_ack = std::move(msg);
+        return this;
+    }
+    Message* AddCancelOrder(CancelOrder msg) {
+        if (type != Msg::EMPTY) {
+            return this; //disallow multiple messages
+        }
+        type = Msg::CANCEL_ORDER;
+        cancel_order = std::move(msg);
+        return this;
+    }
+    Message* AddAmendOrder(AmendOrder msg) {
+        if (type != Msg::EMPTY) {
+            return this; //disallow multiple messages
+        }
+        type = Msg::AMEND_ORDER;
+        amend_order = std::move(msg);
+        return this;
+    }
+
+    // Marks an offer as having reached the AH inbox (see OrderTimestamps)
+    void StampArrival(std::int64_t now_ns) {
+        if (bid_offer) {
+            bid_offer->timestamps.arrived_ns = now_ns;
+        } else if (ask_offer) {
+            ask_offer->timestamps.arrived_ns = now_ns;
+        }
+    }
 
     std::string ToString() const {
         if (type == Msg::EMPTY) {
@@ -375,6 +543,12 @@ public:
             return shutdown_notify->ToString();
         } else if (type == Msg::SHUTDOWN_COMMAND) {
             return shutdown_command->ToString();
+        } else if (type == Msg::ORDER_ACK) {
+            return order_ack->ToString();
+        } else if (type == Msg::CANCEL_ORDER) {
+            return cancel_order->ToString();
+        } else if (type == Msg::AMEND_ORDER) {
+            return amend_order->ToString();
         } else {
             return "ERR: unknown message type";
         }
@@ -0,0 +1,62 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_PRICE_H
+#define CPPBAZAARBOT_PRICE_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+// Price ticks per unit of currency, ie the tick size is 1/PRICE_TICKS_PER_UNIT.
+// Override at build time, eg -DPRICE_TICKS_PER_UNIT=100 to trade in whole cents.
+#ifndef PRICE_TICKS_PER_UNIT
+#define PRICE_TICKS_PER_UNIT 10000
+#endif
+
+// Fixed-point amount of money, held as a whole number of ticks. The order book and settlement work only in Prices, so
+// price levels compare exactly and fee/tax sums don't drift. Traders still reason in doubles and convert at the edge.
+struct Price {
+    static constexpr std::int64_t TICKS_PER_UNIT = PRICE_TICKS_PER_UNIT;
+    static constexpr std::int64_t BASIS_POINTS_PER_UNIT = 10000;
+
+    std::int64_t ticks = 0;
+
+    constexpr Price() = default;
+    constexpr explicit Price(std::int64_t ticks) : ticks(ticks) {};
+
+    // Rounds to the nearest tick
+    static Price FromDouble(double amount) {
+        return Price(std::llround(amount*TICKS_PER_UNIT));
+    }
+    constexpr double ToDouble() const {
+        return (double) ticks / TICKS_PER_UNIT;
+    }
+
+    // bps basis points (hundredths of a percent) of this amount, rounded half away from zero to the nearest tick
+    constexpr Price BasisPoints(std::int64_t bps) const {
+        std::int64_t scaled = ticks*bps;
+        std::int64_t half = (scaled < 0) ? -BASIS_POINTS_PER_UNIT/2 : BASIS_POINTS_PER_UNIT/2;
+        return Price((scaled + half) / BASIS_POINTS_PER_UNIT);
+    }
+
+    std::string ToString() const {
+        return std::to_string(ToDouble());
+    }
+
+    constexpr Price operator+(Price other) const { return Price(ticks + other.ticks); }
+    constexpr Price operator-(Price other) const { return Price(ticks - other.ticks); }
+    constexpr Price operator*(std::int64_t quantity) const { return Price(ticks*quantity); }
+    constexpr Price& operator+=(Price other) { ticks += other.ticks; return *this; }
+    constexpr Price& operator-=(Price other) { ticks -= other.ticks; return *this; }
+
+    constexpr bool operator==(Price other) const { return ticks == other.ticks; }
+    constexpr bool operator!=(Price other) const { return ticks != other.ticks; }
+    constexpr bool operator<(Price other) const { return ticks < other.ticks; }
+    constexpr bool operator>(Price other) const { return ticks > other.ticks; }
+    constexpr bool operator<=(Price other) const { return ticks <= other.ticks; }
+    constexpr bool operator>=(Price other) const { return ticks >= other.ticks; }
+};
+
+#endif//CPPBAZAARBOT_PRICE_H
@@ -0,0 +1,99 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_RING_BUFFER_H
+#define CPPBAZAARBOT_RING_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Fixed-capacity FIFO. Pushing onto a full buffer overwrites the oldest item.
+// Storage is normally allocated once up front; a lazily allocated buffer instead grows as items arrive, up to its
+// capacity, and stops allocating once it first fills.
+// Index 0 is always the oldest item, size()-1 the newest.
+template<typename T>
+class RingBuffer {
+private:
+    std::vector<T> data;
+    std::size_t max_count = 0;
+    std::size_t head = 0;   // index of oldest item in data
+    std::size_t count = 0;
+
+    std::size_t Wrap(std::size_t index) const {
+        return (index >= data.size()) ? index - data.size() : index;
+    }
+
+public:
+    explicit RingBuffer(std::size_t capacity = 0)
+        : data(capacity)
+        , max_count(capacity) {};
+
+    std::size_t size() const { return count; }
+    std::size_t capacity() const { return max_count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == max_count; }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    // Discards all contents
+    void set_capacity(std::size_t capacity, bool allocate_upfront = true) {
+        if (allocate_upfront) {
+            data.assign(capacity, T());
+        } else {
+            data.clear();
+        }
+        max_count = capacity;
+        clear();
+    }
+
+    void push_back(T item) {
+        if (max_count == 0) {
+            return;
+        }
+        if (count < max_count) {
+            if (count == data.size()) {
+                // still growing: straighten out any wrap from earlier pops, then append
+                std::rotate(data.begin(), data.begin() + head, data.end());
+                head = 0;
+                data.push_back(std::move(item));
+            } else {
+                data[Wrap(head + count)] = std::move(item);
+            }
+            count++;
+        } else {
+            data[head] = std::move(item);
+            head = Wrap(head + 1);
+        }
+    }
+
+    void pop_front() {
+        if (count == 0) {
+            return;
+        }
+        head = Wrap(head + 1);
+        count--;
+    }
+
+    void pop_back() {
+        if (count == 0) {
+            return;
+        }
+        count--;
+    }
+
+    T& operator[](std::size_t index) { return data[Wrap(head + index)]; }
+    const T& operator[](std::size_t index) const { return data[Wrap(head + index)]; }
+
+    T& front() { return data[head]; }
+    const T& front() const { return data[head]; }
+    T& back() { return data[Wrap(head + count - 1)]; }
+    const T& back() const { return data[Wrap(head + count - 1)]; }
+};
+
+#endif//CPPBAZAARBOT_RING_BUFFER_H
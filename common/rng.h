@@ -0,0 +1,82 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_RNG_H
+#define CPPBAZAARBOT_RNG_H
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+// PCG32 (XSH-RR): 16 bytes of state, where std::mt19937 carries ~5KB. Meets UniformRandomBitGenerator, so it can
+// drive the std distributions.
+//
+// Every generator in the simulation should come from Stream(), which derives it from the process-wide seed and a
+// stream id (an agent's id, or one of the reserved ids below). The id picks both the PCG increment and, hashed with
+// the seed, the starting state: streams that only differ in increment are visibly correlated. Fixing the global seed
+// (SetGlobalSeed) makes every stream repeat from run to run. Whole runs are only as repeatable as the
+// thread scheduling though, since traders and the AH interleave differently each time.
+class Rng {
+private:
+    std::uint64_t state = 0;
+    std::uint64_t inc = 1;
+
+    static std::uint64_t SplitMix(std::uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+    static std::atomic<std::uint64_t>& GlobalSeedStorage() {
+        // unless told otherwise, a different seed each run (one random_device read per process, not per agent)
+        static std::atomic<std::uint64_t> seed{((std::uint64_t) std::random_device()() << 32) | std::random_device()()};
+        return seed;
+    }
+
+public:
+    using result_type = std::uint32_t;
+
+    // Reserved stream ids, clear of agent ids
+    static constexpr std::uint64_t DRIVER_STREAM = 1ULL << 62;
+    static constexpr std::uint64_t POPULATION_STREAMS = 1ULL << 61;
+
+    explicit Rng(std::uint64_t seed = 0x853C49E6748FEA9BULL, std::uint64_t stream = 0xDA3E39CB94B95BDBULL)
+        : inc((stream << 1u) | 1u) {
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    static void SetGlobalSeed(std::uint64_t seed) {
+        GlobalSeedStorage().store(seed, std::memory_order_relaxed);
+    }
+    static std::uint64_t GlobalSeed() {
+        return GlobalSeedStorage().load(std::memory_order_relaxed);
+    }
+    static Rng Stream(std::uint64_t stream_id) {
+        return Rng(SplitMix(GlobalSeed() ^ SplitMix(stream_id)), stream_id);
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        std::uint64_t old_state = state;
+        state = old_state*6364136223846793005ULL + inc;
+        auto xorshifted = (std::uint32_t) (((old_state >> 18u) ^ old_state) >> 27u);
+        auto rot = (std::uint32_t) (old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31u));
+    }
+
+    // uniform in [0, 1)
+    double Uniform() {
+        return (*this)() * 0x1.0p-32;
+    }
+    bool Chance(double chance) {
+        return (chance >= 1) || Uniform() < chance;
+    }
+};
+
+#endif//CPPBAZAARBOT_RNG_H
@@ -0,0 +1,122 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_THREAD_POOL_H
+#define CPPBAZAARBOT_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../metrics/trace.h"
+
+// Fixed set of worker threads for fork-join parallel loops. ParallelFor() hands out indices one at a time (so uneven
+// items balance themselves) and the calling thread works alongside the pool, so a pool of N workers gives N+1-way
+// parallelism and a pool of 0 workers simply runs the loop inline.
+// Only one ParallelFor may run at a time per pool.
+class WorkerPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_finished;
+    bool stopping = false;
+
+    // current job
+    std::uint64_t generation = 0;
+    const std::function<void(std::size_t)>* job = nullptr;
+    std::size_t job_size = 0;
+    std::atomic<std::size_t> next_index{0};
+    int busy_workers = 0;
+
+    void RunJob(const std::function<void(std::size_t)>& fn, std::size_t size) {
+        std::size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        while (index < size) {
+            fn(index);
+            index = next_index.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void WorkerLoop(const std::string& name) {
+        TraceRecorder::Global().NameThread(name);
+        std::uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_available.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+            if (!job) {
+                continue; //woke after the job had already been completed by others
+            }
+            auto* fn = job;
+            auto size = job_size;
+            busy_workers++;
+            lock.unlock();
+            RunJob(*fn, size);
+            lock.lock();
+            busy_workers--;
+            if (busy_workers == 0) {
+                work_finished.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit WorkerPool(int num_workers, const std::string& name = "worker") {
+        for (int i = 0; i < num_workers; i++) {
+            workers.emplace_back([this, name, i] { WorkerLoop(name + " " + std::to_string(i)); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int NumWorkers() const {
+        return (int) workers.size();
+    }
+
+    // Calls fn(i) for every i in [0, size), returning once all calls have finished
+    void ParallelFor(std::size_t size, const std::function<void(std::size_t)>& fn) {
+        if (workers.empty() || size <= 1) {
+            for (std::size_t i = 0; i < size; i++) {
+                fn(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            job_size = size;
+            next_index = 0;
+            generation++;
+        }
+        work_available.notify_all();
+        RunJob(fn, size);
+
+        // Workers that woke late find no indices left, but must still drop their reference to fn before we return
+        std::unique_lock<std::mutex> lock(mutex);
+        work_finished.wait(lock, [&] { return busy_workers == 0; });
+        job = nullptr;
+    }
+};
+
+#endif//CPPBAZAARBOT_THREAD_POOL_H
@@ -0,0 +1,134 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_TICK_SCHEDULER_H
+#define CPPBAZAARBOT_TICK_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace Tick {
+    // What happens to the ticks that fall due while an overrunning tick is still running (see TickScheduler)
+    enum OverrunPolicy {
+        SKIP,
+        CATCH_UP,
+        STRETCH
+    };
+
+    std::optional<OverrunPolicy> ParsePolicy(const std::string& name) {
+        if (name == "skip") {
+            return SKIP;
+        } else if (name == "catch_up") {
+            return CATCH_UP;
+        } else if (name == "stretch") {
+            return STRETCH;
+        }
+        return std::nullopt;
+    }
+}
+
+struct TickSchedule {
+    int interval_ms = 10;
+    Tick::OverrunPolicy policy = Tick::SKIP;
+    int max_catch_up = 5;               // CATCH_UP: most ticks run late in one burst; any further behind are skipped
+
+    // Adaptive mode: the interval follows the cost of a tick, between these bounds. By default it only ever lengthens.
+    bool adaptive = false;
+    int min_interval_ms = 10;
+    int max_interval_ms = 100;
+    double target_utilisation = 0.5;    // share of each interval spent ticking
+};
+
+// Paces a tick loop against absolute deadlines on the steady clock. Tick k is due at start + k*interval, so neither the
+// tick's own run time nor oversleeping accumulates into drift, as it does when sleeping for "interval - elapsed".
+// When a tick runs past the next deadline, the policy decides what happens to the ticks that fell due meanwhile:
+//   SKIP      they're dropped, and ticking resumes at the next deadline still ahead, on the original cadence
+//   CATCH_UP  they're run back to back (up to max_catch_up behind; any more are dropped), so the number of ticks
+//             keeps pace with the clock
+//   STRETCH   the schedule moves: the next tick starts straight away and the cadence restarts from there
+// In adaptive mode the interval is reset after every tick, from a moving average of tick durations, so that ticking
+// takes target_utilisation of the time. A heavy book then gets fewer, larger ticks instead of constant overruns, and
+// the interval comes back down to min_interval_ms as the book empties.
+class TickScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Next {
+        Clock::time_point due;      // when to start the next tick; now or earlier means straight away
+        int skipped = 0;            // ticks dropped rather than run
+        bool overran = false;       // the tick took longer than the interval
+    };
+
+private:
+    static constexpr double WORK_SMOOTHING = 0.1;  // weight of the latest tick in the moving average
+
+    TickSchedule schedule;
+    Clock::duration interval;
+    Clock::time_point deadline;
+    double avg_work_ns = 0;
+
+    static Clock::duration Milliseconds(int ms) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds{ms});
+    }
+
+    void Adapt(Clock::duration work) {
+        double work_ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(work).count();
+        avg_work_ns = (avg_work_ns == 0) ? work_ns : avg_work_ns + WORK_SMOOTHING*(work_ns - avg_work_ns);
+        auto target = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::nanoseconds{(std::int64_t) (avg_work_ns / schedule.target_utilisation)});
+        interval = std::clamp(target, Milliseconds(schedule.min_interval_ms), Milliseconds(schedule.max_interval_ms));
+    }
+
+public:
+    explicit TickScheduler(const TickSchedule& schedule)
+        : schedule(schedule)
+        , interval(Milliseconds(std::max(1, schedule.interval_ms)))
+        , deadline(Clock::now()) {
+        if (schedule.adaptive) {
+            interval = std::clamp(interval, Milliseconds(schedule.min_interval_ms), Milliseconds(schedule.max_interval_ms));
+        }
+    };
+
+    // The first tick is due straight away
+    void Start() {
+        deadline = Clock::now();
+    }
+
+    Clock::time_point Due() const { return deadline; }
+    Clock::duration Interval() const { return interval; }
+
+    // Called as each tick finishes, with when it started; moves the schedule on to the next one
+    Next Finish(Clock::time_point tick_start, Clock::time_point now = Clock::now()) {
+        Next next;
+        auto work = now - tick_start;
+        next.overran = work > interval;
+        if (schedule.adaptive) {
+            Adapt(work);
+        }
+        deadline += interval;
+        if (now > deadline) {
+            // how many deadlines, this one included, have already gone by
+            auto missed = (int) ((now - deadline) / interval) + 1;
+            if (schedule.policy == Tick::SKIP) {
+                deadline += missed*interval;
+                next.skipped = missed;
+            } else if (schedule.policy == Tick::CATCH_UP) {
+                if (missed > schedule.max_catch_up) {
+                    int dropped = missed - std::max(0, schedule.max_catch_up);
+                    deadline += dropped*interval;
+                    next.skipped = dropped;
+                }
+            } else {
+                deadline = now;
+            }
+        }
+        next.due = deadline;
+        return next;
+    }
+};
+
+#endif//CPPBAZAARBOT_TICK_SCHEDULER_H
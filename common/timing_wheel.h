@@ -0,0 +1,123 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_TIMING_WHEEL_H
+#define CPPBAZAARBOT_TIMING_WHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Hierarchical timing wheel at 1ms resolution: 4 levels of 64 slots cover ~4.6 hours, anything further out waits in
+// an ordered overflow list. Scheduling is O(1), and Advance() only touches the items that are actually due (plus an
+// occasional cascade of a higher-level slot down a level), so the cost of expiry is proportional to what expires
+// rather than to how many items are waiting.
+// There is no cancel: callers should look items up when they fire and ignore any that no longer exist.
+template<typename T>
+class TimingWheel {
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int NUM_SLOTS = 1 << SLOT_BITS;
+    static constexpr int NUM_LEVELS = 4;
+    static constexpr std::uint64_t SLOT_MASK = NUM_SLOTS - 1;
+    static constexpr std::uint64_t WHEEL_RANGE_MS = std::uint64_t(1) << (SLOT_BITS*NUM_LEVELS);
+
+    struct Entry {
+        std::uint64_t expiry_ms;
+        T item;
+    };
+
+    std::array<std::array<std::vector<Entry>, NUM_SLOTS>, NUM_LEVELS> wheels;
+    std::multimap<std::uint64_t, T> overflow;
+    std::uint64_t current_ms = 0;   // the next millisecond to be processed
+    std::size_t num_in_wheels = 0;
+    std::vector<Entry> cascading;   // scratch for Cascade, kept to reuse its capacity
+
+    void Place(Entry entry) {
+        std::uint64_t delta = entry.expiry_ms - current_ms;
+        for (int level = 0; level < NUM_LEVELS; level++) {
+            if (delta < (std::uint64_t(1) << (SLOT_BITS*(level + 1)))) {
+                auto slot = (entry.expiry_ms >> (SLOT_BITS*level)) & SLOT_MASK;
+                wheels[level][slot].push_back(std::move(entry));
+                num_in_wheels++;
+                return;
+            }
+        }
+        overflow.emplace(entry.expiry_ms, std::move(entry.item));
+    }
+
+    // Entering a new period of a level: redistribute that level's current slot into the levels below
+    void Cascade(int level) {
+        auto slot = (current_ms >> (SLOT_BITS*level)) & SLOT_MASK;
+        if (slot == 0 && level + 1 < NUM_LEVELS) {
+            Cascade(level + 1);
+        }
+        auto& entries = wheels[level][slot];
+        if (entries.empty()) {
+            return;
+        }
+        // Swap rather than move, so the slot and the scratch buffer trade capacity instead of freeing it
+        cascading.swap(entries);
+        num_in_wheels -= cascading.size();
+        for (auto& entry : cascading) {
+            Place(std::move(entry));
+        }
+        cascading.clear();
+    }
+
+    void PullFromOverflow() {
+        while (!overflow.empty() && overflow.begin()->first - current_ms < WHEEL_RANGE_MS) {
+            auto node = overflow.begin();
+            Place({node->first, std::move(node->second)});
+            overflow.erase(node);
+        }
+    }
+
+public:
+    std::size_t size() const {
+        return num_in_wheels + overflow.size();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Returns false (and keeps nothing) if expiry_ms is already in the past, ie before the time last advanced to
+    bool Schedule(std::uint64_t expiry_ms, T item) {
+        if (expiry_ms < current_ms) {
+            return false;
+        }
+        Place({expiry_ms, std::move(item)});
+        return true;
+    }
+
+    // Appends every item due strictly before until_ms to expired, in expiry order
+    void Advance(std::uint64_t until_ms, std::vector<T>& expired) {
+        while (current_ms < until_ms) {
+            if (num_in_wheels == 0) {
+                // Nothing in the wheels, so slot positions don't matter: jump straight to the next overflow item
+                std::uint64_t next_ms = overflow.empty() ? until_ms : std::min(until_ms, overflow.begin()->first);
+                if (next_ms > current_ms) {
+                    current_ms = next_ms;
+                    continue;
+                }
+            }
+            PullFromOverflow();
+            if ((current_ms & SLOT_MASK) == 0) {
+                Cascade(1);
+            }
+            auto& due = wheels[0][current_ms & SLOT_MASK];
+            num_in_wheels -= due.size();
+            for (auto& entry : due) {
+                expired.push_back(std::move(entry.item));
+            }
+            due.clear();
+            current_ms++;
+        }
+    }
+};
+
+#endif//CPPBAZAARBOT_TIMING_WHEEL_H
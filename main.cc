@@ -7,33 +7,7 @@
 #include <thread>
 #include <vector>
 
-std::shared_ptr<AITrader> MakeAgent(const std::string& class_name, int curr_id,
-                                    std::shared_ptr<AuctionHouse>& auction_house,
-                                    std::map<std::string, std::vector<InventoryItem>>& inv,
-                                    std::mt19937& gen, int tick_time_ms, Log::LogLevel LOGLEVEL) {
-    double STARTING_MONEY = 500.0;
-    double MIN_COST = 10;
-    std::uniform_real_distribution<> random_money(0.5*STARTING_MONEY, 1.5*STARTING_MONEY); // define the range
-    std::uniform_real_distribution<> random_cost(0.9*MIN_COST, 1.1*MIN_COST); // define the range
-    if (class_name == "farmer") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleFarmer>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else if (class_name == "woodcutter") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleWoodcutter>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else if (class_name == "miner") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleMiner>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else if (class_name == "refiner") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleRefiner>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else if (class_name == "blacksmith") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleBlacksmith>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else if (class_name == "composter") {
-        return CreateAndRegister(curr_id, auction_house, std::make_shared<RoleComposter>(random_cost(gen)), class_name, random_money(gen), 20, inv[class_name], tick_time_ms, LOGLEVEL);
-    } else {
-        std::cout << "Error: Invalid class type passed to make_agent lambda" << std::endl;
-    }
-    return std::shared_ptr<AITrader>();
-}
-
-std::string ChooseNewClassRandom(std::vector<std::string>& tracked_roles, std::mt19937& gen) {
+std::string ChooseNewClassRandom(std::vector<std::string>& tracked_roles, Rng& gen) {
     std::uniform_int_distribution<> random_job(0, (int) tracked_roles.size() - 1); // define the range
     int new_job = random_job(gen);
     return tracked_roles[new_job];
@@ -41,7 +15,8 @@ std::string ChooseNewClassRandom(std::vector<std::string>& tracked_roles, std::m
 
 
 
-void Run(double duration_s, double animation_fps, double trader_tps) {
+void Run(const Economy& economy, double duration_s, double animation_fps, double trader_tps, const std::string& trace_path,
+         const std::string& restore_path, const std::string& checkpoint_path, const TickSchedule& tick_schedule) {
     int NUM_TRADERS_EACH_TYPE = 10;
     int TARGET_NUM_TRADERS = 120;
     int DURATION_MS = (int) duration_s*1000; //60 second simulation
@@ -65,82 +40,63 @@ void Run(double duration_s, double animation_fps, double trader_tps) {
     using std::chrono::duration;
     using std::chrono::milliseconds;
 
-    std::random_device rd; // obtain a random number from hardware
-    std::mt19937 gen(rd()); // seed the generator
+    if (!trace_path.empty()) {
+        TraceRecorder::Global().Enable();
+        TraceRecorder::Global().NameThread("driver");
+    }
+
+    Rng gen = Rng::Stream(Rng::DRIVER_STREAM);
 
-    std::vector<std::string> tracked_goods = {"food", "wood", "fertilizer", "ore", "metal", "tools"};
-    std::vector<std::string> tracked_roles = {"farmer", "woodcutter", "composter", "miner", "refiner", "blacksmith"};
+    std::vector<std::string> tracked_goods = economy.CommodityNames();
+    std::vector<std::string> tracked_roles = economy.RoleNames();
 
     auto file_mutex = std::make_shared<std::mutex>();
     auto metrics_start_time = to_unix_timestamp_ms(std::chrono::high_resolution_clock::now());
     auto global_metrics = GlobalMetrics(metrics_start_time, tracked_goods, tracked_roles, file_mutex);
 
-    // --- SET UP DEFAULT COMMODITIES ---
-    std::map<std::string, Commodity> comm;
-    {
-        comm.emplace("food", Commodity("food", 0.5));
-        comm.emplace("wood", Commodity("wood", 1));
-        comm.emplace("ore", Commodity("ore", 1));
-        comm.emplace("metal", Commodity("metal", 1));
-        comm.emplace("tools", Commodity("tools", 1));
-        comm.emplace("fertilizer", Commodity("fertilizer", 0.1));
-    }
-    // --- SET UP DEFAULT INVENTORIES ---
-    std::map<std::string, std::vector<InventoryItem>> inv;
-    std::vector<InventoryItem> player_inv = {{comm["food"], 10, 10},
-                                             {comm["tools"], 10, 10},
-                                             {comm["wood"], 10, 10},
-                                             {comm["fertilizer"], 10, 10}};
-    {
-        inv.emplace("farmer", std::vector<InventoryItem>{{comm["food"], 0, 0},
-                                                         {comm["tools"], 1, 2},
-                                                         {comm["wood"], 1, 6},
-                                                         {comm["fertilizer"], 1, 6}});
-
-        inv.emplace("miner", std::vector<InventoryItem>{{comm["food"], 1, 6},
-                                                        {comm["tools"], 1, 2},
-                                                        {comm["ore"], 0, 0}});
-
-        inv.emplace("refiner", std::vector<InventoryItem>{{comm["food"], 1, 6},
-                                                          {comm["tools"], 1, 2},
-                                                          {comm["ore"], 1, 10},
-                                                          {comm["metal"], 0, 0}});
-
-        inv.emplace("woodcutter", std::vector<InventoryItem>{{comm["food"], 1, 6},
-                                                             {comm["tools"], 1, 2},
-                                                             {comm["wood"], 0, 0}});
-
-        inv.emplace("blacksmith", std::vector<InventoryItem>{{comm["food"], 1, 6},
-                                                             {comm["tools"], 0, 0},
-                                                             {comm["metal"], 0, 10}});
-
-        inv.emplace("composter", std::vector<InventoryItem>{{comm["food"], 1, 6},
-                                                            {comm["fertilizer"], 0, 0}});
+    std::vector<InventoryItem> player_inv;
+    for (auto& good : {"food", "tools", "wood", "fertilizer"}) {
+        int commodity_id = economy.CommodityId(good);
+        if (commodity_id >= 0) {
+            player_inv.emplace_back(economy.commodities[commodity_id], 10, 10);
+        }
     }
 
     // --- SET UP AUCTION HOUSE ---
     int max_id = 0;
     auto auction_house = std::make_shared<AuctionHouse>(max_id, AH_log_level);
+    auction_house->SetTickSchedule(tick_schedule);
     max_id++;
-    for (auto& item : comm) {
-        auction_house->RegisterCommodity(item.second);
+    for (auto& commodity : economy.commodities) {
+        auction_house->RegisterCommodity(commodity);
     }
-    std::thread auction_house_thread(&AuctionHouse::Tick, auction_house, DURATION_MS);
     // --- SET UP AI TRADERS ---
-    for (int i = 0; i < NUM_TRADERS_EACH_TYPE; i++) {
-        for (auto& role : tracked_roles) {
-            auto new_agent = MakeAgent(role, max_id, auction_house, inv, gen, TRADER_TICK_TIME_MS, trader_log_level);
-            max_id++;
-            std::thread new_agent_thread(&AITrader::Tick, new_agent);
-            new_agent_thread.detach();
+    // Dead traders are recycled into the replacements, so churn doesn't cost threads or allocations
+    TraderPool trader_pool(auction_house, TRADER_TICK_TIME_MS, trader_log_level);
+    if (!restore_path.empty()) {
+        // warm start: the AH must not be ticking while its state is replaced
+        auto restore_start = high_resolution_clock::now();
+        auto next_id = RestoreCheckpoint(restore_path, economy, *auction_house, trader_pool);
+        if (!next_id) {
+            return;
         }
+        max_id = *next_id;
+        duration<double, std::milli> restore_ms = high_resolution_clock::now() - restore_start;
+        std::cout << "Restored " << auction_house->GetNumTraders() << " traders from " << restore_path << " in " << restore_ms.count() << "ms" << std::endl;
+    } else {
+        std::vector<int> starting_roles;
+        for (int i = 0; i < NUM_TRADERS_EACH_TYPE; i++) {
+            for (int role_id = 0; role_id < (int) economy.roles.size(); role_id++) {
+                starting_roles.push_back(role_id);
+            }
+        }
+        int composter_id = economy.RoleId("composter");
+        for (int i = 0; i < 20 && composter_id >= 0; i++) {
+            starting_roles.push_back(composter_id);
+        }
+        MakeAgents(economy, starting_roles, max_id, trader_pool, gen);
     }
-    for (int i = 0; i < 20; i++) {
-        auto new_composter = MakeAgent("composter", max_id, auction_house, inv, gen, TRADER_TICK_TIME_MS, trader_log_level);
-        max_id++;
-        std::thread new_composter_thread(&AITrader::Tick, new_composter);
-        new_composter_thread.detach();
-    }
+    std::thread auction_house_thread(&AuctionHouse::Tick, auction_house, DURATION_MS);
 //    // --- SET UP FAKE TRADER ---
 //    auto fake_trader = std::make_shared<FakeTrader>(max_id, auction_house);
 //    {
@@ -158,7 +114,7 @@ void Run(double duration_s, double animation_fps, double trader_tps) {
 //    }
 
     global_metrics.CollectMetrics(auction_house);
-    auto global_display = GlobalDisplay(metrics_start_time, auction_house, TARGET_ANIMATION_MS, file_mutex, tracked_goods);
+    auto global_display = GlobalDisplay(metrics_start_time, auction_house, TARGET_ANIMATION_MS, global_metrics, tracked_goods);
     if (animation_fps <= 0) {
         global_display.active = false;
     }
@@ -174,16 +130,18 @@ void Run(double duration_s, double animation_fps, double trader_tps) {
         curr_tick++;
         int num_traders = auction_house->GetNumTraders();
         if (num_traders < TARGET_NUM_TRADERS) {
+            std::vector<int> new_roles;
             for (int i = 0; i < TARGET_NUM_TRADERS- num_traders; i++) {
-                auto new_role = ChooseNewClassWeighted(tracked_goods, auction_house, gen);
-                auto new_agent = MakeAgent(new_role, max_id, auction_house, inv, gen, TRADER_TICK_TIME_MS, trader_log_level);
-                max_id++;
-                std::thread new_agent_thread(&AITrader::Tick, new_agent);
-                new_agent_thread.detach();
+                auto new_role = ChooseNewClassWeighted(economy, auction_house, gen);
+                if (new_role < 0) {
+                    continue;
+                }
+                new_roles.push_back(new_role);
             }
+            MakeAgents(economy, new_roles, max_id, trader_pool, gen);
         }
         if (elapsed > prev_write_time + write_step) {
-            global_metrics.update_datafiles(prev_write_time);
+            global_metrics.update_datafiles();
             prev_write_time = elapsed;
         }
         global_metrics.CollectMetrics(auction_house);
@@ -208,8 +166,24 @@ void Run(double duration_s, double animation_fps, double trader_tps) {
     std::cout << "Manually shutdown AH" << std::endl;
     auction_house->Shutdown();
     auction_house_thread.join();
+    trader_pool.Shutdown();
+    if (!checkpoint_path.empty()) {
+        auto checkpoint_start = high_resolution_clock::now();
+        if (WriteCheckpoint(checkpoint_path, *auction_house, trader_pool.Traders())) {
+            duration<double, std::milli> checkpoint_ms = high_resolution_clock::now() - checkpoint_start;
+            std::cout << "Wrote checkpoint to " << checkpoint_path << " in " << checkpoint_ms.count() << "ms" << std::endl;
+        }
+    }
     global_display.DrawChart(true);
     global_display.Shutdown();
+    if (!trace_path.empty()) {
+        TraceRecorder::Global().Disable();
+        if (TraceRecorder::Global().WriteJson(trace_path)) {
+            std::cout << "Wrote trace to " << trace_path << " (" << TraceRecorder::Global().NumDropped() << " events dropped)" << std::endl;
+        } else {
+            std::cout << "Error: Failed to write trace to " << trace_path << std::endl;
+        }
+    }
 
     for (auto& good : tracked_goods) {
         std::cout << "\t\t\t" << good;
@@ -232,11 +206,16 @@ void Run(double duration_s, double animation_fps, double trader_tps) {
     }
 
     std::cout << "\nAverage age on death: " << global_metrics.avg_lifespan << std::endl;
+    std::cout << "Trader slots: " << trader_pool.NumSlots() << " (" << trader_pool.NumRecycled() << " respawns recycled)" << std::endl;
 //    for (auto& role : tracked_roles) {
 //        std::cout << role << ": " << global_metrics.age_per_class[role] << "(" <<global_metrics.deaths_per_class[role] <<" total)" << std::endl;
 //    }
 
-    std::cout << "Total auction house profit :" << auction_house->spread_profit << std::endl;
+    std::cout << "AH ticks: " << auction_house->counters.ticks << " run, " << auction_house->counters.ticks_skipped << " skipped, "
+              << auction_house->counters.overruns << " overran" << std::endl;
+    std::cout << "Total auction house profit :" << auction_house->spread_profit.ToDouble() << std::endl;
+    std::cout << "\nPhase timings:\n" << auction_house->timings.Summary() << AITrader::timings.Summary() << std::endl;
+    std::cout << "Order lifecycle latencies:\n" << AITrader::order_latency.Summary() << std::endl;
     auction_house.reset();
     std::cout << "Finished" << std::endl;
 }
@@ -246,6 +225,29 @@ int main(int argc, char *argv[]) {
     double duration_s = (argc > 1) ? std::stod(std::string(argv[1])) : 60;
     double animation_fps = (argc > 2) ? std::stod(std::string(argv[2])) : 2;
     double trader_tps = (argc > 3) ? std::stod(std::string(argv[3])) : 5;
-    Run(duration_s, animation_fps, trader_tps);
+    std::string trace_path = (argc > 4) ? std::string(argv[4]) : "";
+    std::optional<Economy> economy = (argc > 5 && argv[5][0] != '\0') ? Economy::Load(std::string(argv[5])) : Economy::Default();
+    if (argc > 6 && argv[6][0] != '\0') {
+        // fixes every trader's random stream, so runs can be repeated
+        Rng::SetGlobalSeed(std::stoull(std::string(argv[6])));
+    }
+    if (!economy) {
+        return 1;
+    }
+    // warm start from a checkpoint written by an earlier run, and/or write one at the end of this run
+    std::string restore_path = (argc > 7) ? std::string(argv[7]) : "";
+    std::string checkpoint_path = (argc > 8) ? std::string(argv[8]) : "";
+    // AH overrun policy (skip | catch_up | stretch), and whether its tick interval adapts to load
+    TickSchedule tick_schedule;
+    if (argc > 9 && argv[9][0] != '\0') {
+        auto policy = Tick::ParsePolicy(std::string(argv[9]));
+        if (!policy) {
+            std::cout << "Error: Unknown tick policy " << argv[9] << " (expected skip, catch_up or stretch)" << std::endl;
+            return 1;
+        }
+        tick_schedule.policy = *policy;
+    }
+    tick_schedule.adaptive = (argc > 10) && std::stoi(std::string(argv[10])) != 0;
+    Run(*economy, duration_s, animation_fps, trader_tps, trace_path, restore_path, checkpoint_path, tick_schedule);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,291 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_ASCII_CHART_H
+#define CPPBAZAARBOT_ASCII_CHART_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A single line on the chart. Points are (x, y) pairs in ascending x order.
+struct ChartSeries {
+    std::string name;
+    char glyph = '*';
+    std::string colour;     // ANSI colour escape (eg "\x1b[1;32m"), may be empty
+    bool visible = true;
+    std::vector<std::pair<double, double>> points;
+
+    ChartSeries(std::string name, char glyph, std::string colour)
+        : name(std::move(name))
+        , glyph(glyph)
+        , colour(std::move(colour)) {};
+};
+
+// Renders line charts straight into a character grid, laid out like gnuplot's "dumb" terminal:
+//   title / framed plot area with y-axis labels / x-axis labels / legend
+// All buffers are kept between frames so redrawing a same-sized chart does not reallocate.
+class AsciiChart {
+private:
+    static constexpr int LABEL_WIDTH = 10;  // y-axis labels, including the trailing space
+    static constexpr int MIN_WIDTH = LABEL_WIDTH + 20;
+    static constexpr int MIN_HEIGHT = 10;
+    static constexpr int NO_SERIES = -1;
+    static constexpr int FRAME = -2;
+
+    int width = 0;
+    int height = 0;
+    std::vector<char> cells;
+    std::vector<int> owners;    // index of the series that drew each cell
+    std::string axis;
+    std::string out;
+
+public:
+    std::vector<ChartSeries> series;
+
+    void AddSeries(const std::string& name, char glyph, const std::string& colour) {
+        series.emplace_back(name, glyph, colour);
+    }
+
+    ChartSeries* GetSeries(const std::string& name) {
+        for (auto& line : series) {
+            if (line.name == name) {
+                return &line;
+            }
+        }
+        return nullptr;
+    }
+
+    const std::string& Render(const std::string& title, int term_width, int term_height, double x_min, double x_max, bool colour) {
+        out.clear();
+        if (term_width < MIN_WIDTH || term_height < MIN_HEIGHT) {
+            out = "Terminal too small to draw chart";
+            return out;
+        }
+        if (x_max <= x_min) {
+            x_max = x_min + 1;
+        }
+        Resize(term_width, term_height);
+
+        // Plot area, inside the frame
+        int left = LABEL_WIDTH + 1;
+        int right = width - 2;
+        int top = 2;
+        int bottom = height - 4;
+
+        double y_min, y_max;
+        FindYRange(x_min, x_max, y_min, y_max);
+
+        DrawFrame(left - 1, right + 1, top - 1, bottom + 1);
+        for (int i = 0; i < (int) series.size(); i++) {
+            if (series[i].visible) {
+                DrawSeries(i, x_min, x_max, y_min, y_max, left, right, top, bottom);
+            }
+        }
+
+        out.reserve(cells.size() * 2 + 256);
+        WriteCentred(title);
+        WriteRows(top - 1, bottom + 1, y_min, y_max, top, bottom, colour);
+        WriteXLabels(x_min, x_max, left, right);
+        WriteLegend(colour);
+        return out;
+    }
+
+private:
+    void Resize(int w, int h) {
+        width = w;
+        height = h;
+        cells.assign((std::size_t) width * height, ' ');
+        owners.assign((std::size_t) width * height, NO_SERIES);
+    }
+
+    void Set(int col, int row, char glyph, int owner) {
+        cells[(std::size_t) row * width + col] = glyph;
+        owners[(std::size_t) row * width + col] = owner;
+    }
+
+    void FindYRange(double x_min, double x_max, double& y_min, double& y_max) const {
+        y_min = 0;
+        y_max = 0;
+        bool found = false;
+        for (const auto& line : series) {
+            if (!line.visible) {
+                continue;
+            }
+            for (const auto& point : line.points) {
+                if (point.first < x_min || point.first > x_max) {
+                    continue;
+                }
+                if (!found) {
+                    y_min = point.second;
+                    y_max = point.second;
+                    found = true;
+                }
+                y_min = std::min(y_min, point.second);
+                y_max = std::max(y_max, point.second);
+            }
+        }
+        if (y_max - y_min < 1e-9) {
+            y_min -= 1;
+            y_max += 1;
+        }
+        double padding = 0.05 * (y_max - y_min);
+        y_min -= padding;
+        y_max += padding;
+    }
+
+    void DrawFrame(int left, int right, int top, int bottom) {
+        for (int col = left; col <= right; col++) {
+            Set(col, top, '-', FRAME);
+            Set(col, bottom, '-', FRAME);
+        }
+        for (int row = top; row <= bottom; row++) {
+            Set(left, row, '|', FRAME);
+            Set(right, row, '|', FRAME);
+        }
+        Set(left, top, '+', FRAME);
+        Set(right, top, '+', FRAME);
+        Set(left, bottom, '+', FRAME);
+        Set(right, bottom, '+', FRAME);
+    }
+
+    void DrawSeries(int index, double x_min, double x_max, double y_min, double y_max, int left, int right, int top, int bottom) {
+        const auto& points = series[index].points;
+        double x_scale = (right - left) / (x_max - x_min);
+        double y_scale = (bottom - top) / (y_max - y_min);
+
+        bool have_prev = false;
+        int prev_col = 0;
+        int prev_row = 0;
+        for (std::size_t i = 0; i < points.size(); i++) {
+            // keep the last point before the window so the line enters from the left edge
+            if (points[i].first < x_min && i + 1 < points.size() && points[i + 1].first < x_min) {
+                continue;
+            }
+            if (points[i].first > x_max) {
+                break;
+            }
+            int col = left + (int) std::lround((points[i].first - x_min) * x_scale);
+            int row = bottom - (int) std::lround((points[i].second - y_min) * y_scale);
+            if (have_prev) {
+                DrawLine(index, prev_col, prev_row, col, row, left, right, top, bottom);
+            } else {
+                Plot(index, col, row, left, right, top, bottom);
+            }
+            prev_col = col;
+            prev_row = row;
+            have_prev = true;
+        }
+    }
+
+    void Plot(int index, int col, int row, int left, int right, int top, int bottom) {
+        if (col < left || col > right || row < top || row > bottom) {
+            return;
+        }
+        Set(col, row, series[index].glyph, index);
+    }
+
+    // Bresenham, clipped to the plot area
+    void DrawLine(int index, int x0, int y0, int x1, int y1, int left, int right, int top, int bottom) {
+        int dx = std::abs(x1 - x0);
+        int dy = -std::abs(y1 - y0);
+        int step_x = (x0 < x1) ? 1 : -1;
+        int step_y = (y0 < y1) ? 1 : -1;
+        int err = dx + dy;
+        while (true) {
+            Plot(index, x0, y0, left, right, top, bottom);
+            if (x0 == x1 && y0 == y1) {
+                break;
+            }
+            int e2 = 2 * err;
+            if (e2 >= dy) {
+                err += dy;
+                x0 += step_x;
+            }
+            if (e2 <= dx) {
+                err += dx;
+                y0 += step_y;
+            }
+        }
+    }
+
+    void WriteCentred(const std::string& text) {
+        int pad = std::max(0, (width - (int) text.size()) / 2);
+        out.append(pad, ' ');
+        out.append(text);
+        out.push_back('\n');
+    }
+
+    void WriteRows(int first, int last, double y_min, double y_max, int top, int bottom, bool colour) {
+        int label_every = std::max(1, (bottom - top) / 5);
+        char label[32];
+        for (int row = first; row <= last; row++) {
+            if (row >= top && row <= bottom && (bottom - row) % label_every == 0) {
+                double value = y_min + (y_max - y_min) * (bottom - row) / (bottom - top);
+                std::snprintf(label, sizeof(label), "%*.2f ", LABEL_WIDTH - 1, value);
+                out.append(label, LABEL_WIDTH);
+            } else {
+                out.append(LABEL_WIDTH, ' ');
+            }
+
+            int current_owner = NO_SERIES;
+            for (int col = LABEL_WIDTH; col < width; col++) {
+                int owner = owners[(std::size_t) row * width + col];
+                if (colour && owner != current_owner) {
+                    if (current_owner >= 0 && !series[current_owner].colour.empty()) {
+                        out.append("\x1b[0m");
+                    }
+                    if (owner >= 0) {
+                        out.append(series[owner].colour);
+                    }
+                    current_owner = owner;
+                }
+                out.push_back(cells[(std::size_t) row * width + col]);
+            }
+            if (colour && current_owner >= 0 && !series[current_owner].colour.empty()) {
+                out.append("\x1b[0m");
+            }
+            out.push_back('\n');
+        }
+    }
+
+    void WriteXLabels(double x_min, double x_max, int left, int right) {
+        axis.assign((std::size_t) width, ' ');
+        int num_labels = 5;
+        char label[32];
+        for (int i = 0; i < num_labels; i++) {
+            double value = x_min + (x_max - x_min) * i / (num_labels - 1);
+            int len = std::snprintf(label, sizeof(label), "%.1f", value);
+            int centre = left + (right - left) * i / (num_labels - 1);
+            int start = std::max(0, std::min(width - len, centre - len / 2));
+            axis.replace(start, len, label, len);
+        }
+        out.append(axis);
+        out.push_back('\n');
+    }
+
+    void WriteLegend(bool colour) {
+        out.append(LABEL_WIDTH, ' ');
+        for (const auto& line : series) {
+            if (!line.visible) {
+                continue;
+            }
+            out.append("  ");
+            if (colour && !line.colour.empty()) {
+                out.append(line.colour);
+                out.push_back(line.glyph);
+                out.append("\x1b[0m");
+            } else {
+                out.push_back(line.glyph);
+            }
+            out.push_back(' ');
+            out.append(line.name);
+        }
+    }
+};
+
+#endif//CPPBAZAARBOT_ASCII_CHART_H
@@ -5,6 +5,7 @@
 #ifndef CPPBAZAARBOT_DISPLAY_H
 #define CPPBAZAARBOT_DISPLAY_H
 #include "metrics.h"
+#include "ascii_chart.h"
 
 #if defined(__linux__)
 #include <sys/ioctl.h>
@@ -20,8 +21,10 @@ void get_terminal_size(int& width, int& height) {
 //    width = (int)(csbi.srWindow.Right-csbi.srWindow.Left+1);
 //    height = (int)(csbi.srWindow.Bottom-csbi.srWindow.Top+1);
 #elif defined(__linux__)
-    struct winsize w;
-    ioctl(fileno(stdout), TIOCGWINSZ, &w);
+    struct winsize w{};
+    if (ioctl(fileno(stdout), TIOCGWINSZ, &w) != 0 || w.ws_col == 0 || w.ws_row == 0) {
+        return; // not a terminal, keep the caller's defaults
+    }
     width = (int)(w.ws_col);
     height = (int)(w.ws_row);
 #endif // Windows/Linux
@@ -34,35 +37,47 @@ private:
     std::uint64_t start_time;
     std::uint64_t offset;
     int chart_update_ms;
-    std::shared_ptr<std::mutex> file_mutex;
+    GlobalMetrics& metrics;
     std::shared_ptr<AuctionHouse> auction_house;
     std::vector<std::string> tracked_goods;
     std::map<std::string, bool> visible;
-    std::map<std::string, std::tuple<std::string, std::string>> hardcoded_legend;
+    std::map<std::string, std::tuple<char, std::string>> hardcoded_legend;
+
+    std::mutex chart_mutex;
+    AsciiChart chart;
 
     std::thread chart_thread;
 public:
     std::atomic_bool destroyed = false;
     std::atomic_bool active = true;
 
-    GlobalDisplay(std::uint64_t start_time, std::shared_ptr<AuctionHouse> auction_house, double chart_update_ms, std::shared_ptr<std::mutex> mutex, const std::vector<std::string>& tracked_goods)
+    GlobalDisplay(std::uint64_t start_time, std::shared_ptr<AuctionHouse> auction_house, double chart_update_ms, GlobalMetrics& metrics, const std::vector<std::string>& tracked_goods)
             : start_time(start_time)
             , auction_house(auction_house)
             , chart_update_ms(chart_update_ms)
-            , file_mutex(std::move(mutex))
-            , tracked_goods(tracked_goods)
-            , chart_thread([this] { Tick(); }) {
+            , metrics(metrics)
+            , tracked_goods(tracked_goods) {
         offset = to_unix_timestamp_ms(std::chrono::system_clock::now()) - start_time;
+        hardcoded_legend = {};
+        hardcoded_legend["food"] = {'*', "\x1b[1;32m"};
+        hardcoded_legend["wood"] = {'#', "\x1b[1;33m"};
+        hardcoded_legend["fertilizer"] = {'$', "\x1b[1;35m"};
+        hardcoded_legend["ore"] = {'%', "\x1b[1;31m"};
+        hardcoded_legend["metal"] = {'@', "\x1b[1;37m"};
+        hardcoded_legend["tools"] = {'&', "\x1b[1;34m"};
+
+        std::string fallback_glyphs = "+x=o~^";
+        int num_fallbacks = 0;
         for (auto& good : tracked_goods) {
             visible[good] = true;
+            if (hardcoded_legend.count(good) == 1) {
+                chart.AddSeries(good, std::get<0>(hardcoded_legend[good]), std::get<1>(hardcoded_legend[good]));
+            } else {
+                chart.AddSeries(good, fallback_glyphs[num_fallbacks % fallback_glyphs.size()], "");
+                num_fallbacks++;
+            }
         }
-        hardcoded_legend = {};
-        hardcoded_legend["food"] = {R"(\*)", "\x1b[1;32m*\x1b[0m"};
-        hardcoded_legend["wood"] = {"#", "\x1b[1;33m#\x1b[0m"};
-        hardcoded_legend["fertilizer"] = {R"(\$)", "\x1b[1;35m$\x1b[0m"};
-        hardcoded_legend["ore"] = {"%", "\x1b[1;31m%\x1b[0m"};
-        hardcoded_legend["metal"] = {"@", "\x1b[1;37m@\x1b[0m"};
-        hardcoded_legend["tools"] = {"&", "\x1b[1;34m&\x1b[0m"};
+        chart_thread = std::thread([this] { Tick(); });
     }
 
     void Shutdown() {
@@ -70,7 +85,6 @@ public:
         if (chart_thread.joinable()) {
             chart_thread.join();
         }
-        file_mutex.reset();
     }
     void Tick() {
         int working_frametime_ms;
@@ -126,45 +140,28 @@ public:
         }
     }
     void DrawChart(bool all = false) {
-        std::string out;
-#if __linux__
+        std::lock_guard<std::mutex> lock(chart_mutex);
         int x = 100;
-        int y = 100;
+        int y = 40;
         get_terminal_size(x, y);
         y -= 7;//leave space for legend at bottom
 
         auto local_curr_time = to_unix_timestamp_ms(std::chrono::system_clock::now());
         double time_passed_s = (double)(local_curr_time - offset - start_time) / 1000;
+        double window_start_s = (all) ? 0 : time_passed_s - (window_ms/1000);
 
-        std::string args = "gnuplot -e \"set term dumb " + std::to_string(x)+ " " + std::to_string(y);
-        args += ";set offsets 0, 0, 0, 0";
-        args += ";set title 'Prices'";
-        if (all) {
-            args += ";set xrange [0:" + std::to_string(time_passed_s) + "]";
-        } else {
-            args += ";set xrange ["+ std::to_string(time_passed_s - (window_ms/1000)) + ":" + std::to_string(time_passed_s) + "]";
-        }
-
-        args += ";plot ";
-        for (auto& good : tracked_goods) {
-            if (visible[good]) {
-                args += "'global_tmp/"+good+".dat' with lines title '" + good + "',";
+        for (auto& line : chart.series) {
+            line.visible = visible[line.name];
+            if (line.visible) {
+                metrics.CopyPriceHistory(line.name, window_start_s, line.points);
             }
         }
-        args += "\"";
-        // GENERATE ASCII PLOT
-        file_mutex->lock();
-        out = GetStdoutFromCommand(args);
-        file_mutex->unlock();
-        // Set colors using ANSI codes
-        // Could do this all in 1 pass, but O(n) + O(n) is still O(n)
-        for (auto& leg : hardcoded_legend) {
-            out = std::regex_replace(out, std::regex(std::get<0>(leg.second)), std::get<1>(leg.second));
-        }
+#if __linux__
+        bool colour = true;
 #else
-        out = "Chart-drawing not supported on non-Linux platforms!";
+        bool colour = false;
 #endif
-        std::cout << out << std::endl;
+        std::cout << chart.Render("Prices", x, y, window_start_s, time_passed_s, colour) << std::endl;
     }
 };
 
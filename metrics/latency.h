@@ -0,0 +1,157 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_LATENCY_H
+#define CPPBAZAARBOT_LATENCY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// HDR-style histogram of durations in nanoseconds.
+// Values are bucketed by power of two, and each power of two is split into SUB_BUCKETS linear sub-buckets, giving
+// ~3% relative precision across the whole range. Recording is a handful of relaxed atomic operations, so it is
+// cheap enough to leave on permanently and safe to record from many threads while another thread reads percentiles.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    std::array<std::atomic<std::uint64_t>, NUM_BUCKETS> buckets{};
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> max{0};
+
+    static int BucketIndex(std::uint64_t value) {
+        if (value < (std::uint64_t) SUB_BUCKETS) {
+            return (int) value;
+        }
+        int magnitude = 63 - __builtin_clzll(value);
+        int shift = magnitude - SUB_BUCKET_BITS;
+        int sub_bucket = (int) (value >> shift) - SUB_BUCKETS;
+        return (shift + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    // midpoint of the range of values that map to this bucket
+    static std::uint64_t BucketValue(int index) {
+        if (index < SUB_BUCKETS) {
+            return (std::uint64_t) index;
+        }
+        int shift = index / SUB_BUCKETS - 1;
+        std::uint64_t sub_bucket = index % SUB_BUCKETS;
+        std::uint64_t lower = (SUB_BUCKETS + sub_bucket) << shift;
+        return lower + ((std::uint64_t(1) << shift) >> 1);
+    }
+
+public:
+    std::string name;
+
+    explicit LatencyHistogram(std::string name = "")
+        : name(std::move(name)) {};
+
+    void Record(std::uint64_t value_ns) {
+        buckets[BucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(value_ns, std::memory_order_relaxed);
+        std::uint64_t prev_max = max.load(std::memory_order_relaxed);
+        while (value_ns > prev_max && !max.compare_exchange_weak(prev_max, value_ns, std::memory_order_relaxed)) {}
+    }
+
+    std::uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+    std::uint64_t Max() const { return max.load(std::memory_order_relaxed); }
+    double Mean() const {
+        auto n = Count();
+        return (n > 0) ? (double) total.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    // quantile in [0, 1], eg 0.99 for p99
+    std::uint64_t Percentile(double quantile) const {
+        auto n = Count();
+        if (n == 0) {
+            return 0;
+        }
+        auto target = (std::uint64_t) (quantile * n);
+        if (target >= n) {
+            target = n - 1;
+        }
+        std::uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > target) {
+                return std::min(BucketValue(i), Max());
+            }
+        }
+        return Max();
+    }
+
+    void Reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count = 0;
+        total = 0;
+        max = 0;
+    }
+
+    // eg: "FlushInbox        n=1200     p50=1.20us    p99=10.30us   p999=52.10us   max=1.21ms"
+    std::string Summary() const {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-26s n=%-10llu p50=%-10s p99=%-10s p999=%-10s max=%s",
+                      name.c_str(), (unsigned long long) Count(),
+                      FormatDuration(Percentile(0.5)).c_str(),
+                      FormatDuration(Percentile(0.99)).c_str(),
+                      FormatDuration(Percentile(0.999)).c_str(),
+                      FormatDuration(Max()).c_str());
+        return std::string(line);
+    }
+
+    static std::string FormatDuration(std::uint64_t ns) {
+        char out[32];
+        if (ns < 1000) {
+            std::snprintf(out, sizeof(out), "%lluns", (unsigned long long) ns);
+        } else if (ns < 1000000) {
+            std::snprintf(out, sizeof(out), "%.2fus", ns / 1e3);
+        } else if (ns < 1000000000) {
+            std::snprintf(out, sizeof(out), "%.2fms", ns / 1e6);
+        } else {
+            std::snprintf(out, sizeof(out), "%.2fs", ns / 1e9);
+        }
+        return std::string(out);
+    }
+};
+
+// Records the lifetime of the enclosing scope into a histogram
+class ScopedLatency {
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+public:
+    explicit ScopedLatency(LatencyHistogram& histogram)
+        : histogram(histogram)
+        , start(std::chrono::steady_clock::now()) {};
+    ~ScopedLatency() {
+        histogram.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+// Times consecutive phases of a function: each Lap() records the time since the previous lap
+class LapTimer {
+private:
+    std::chrono::steady_clock::time_point last;
+public:
+    LapTimer()
+        : last(std::chrono::steady_clock::now()) {};
+    void Lap(LatencyHistogram& histogram) {
+        auto now = std::chrono::steady_clock::now();
+        histogram.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        last = now;
+    }
+};
+
+#endif//CPPBAZAARBOT_LATENCY_H
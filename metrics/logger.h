@@ -32,6 +32,12 @@ public:
         , name(name) {};
 
     virtual void LogInternal(std::string raw_message) const = 0;
+
+    // Check before building an expensive message on a hot path, since the arguments to Log() are built regardless
+    bool Enabled(Log::LogLevel level) const {
+        return level <= verbosity;
+    }
+
     void LogSent(int to, Log::LogLevel level, std::string message) const {
         if (level > verbosity) {
             return;
@@ -92,22 +98,43 @@ public:
 
 class FileLogger : public Logger {
 private:
-    FILE * log_file;
+    FILE * log_file = nullptr;
 public:
     FileLogger(Log::LogLevel verbosity, std::string unique_name)
         : Logger(verbosity, unique_name) {
-        //keep file open since we log frequently
-        log_file = std::fopen (("logs/" + unique_name + "_log.txt").c_str(), "w");
-        std::fwrite("# Log file\n", 1, 11, log_file);
+        Open();
     };
 
     ~FileLogger() {
-      std::fclose(log_file);
+      if (log_file) {
+          std::fclose(log_file);
+      }
+    }
+    // Carry on in a fresh file under a new name (for a recycled trader)
+    void Rename(std::string unique_name) {
+        if (log_file) {
+            std::fclose(log_file);
+            log_file = nullptr;
+        }
+        name = std::move(unique_name);
+        Open();
     }
+
     void LogInternal(std::string raw_message) const override {
         raw_message += "\n";
         std::fwrite(raw_message.c_str(), 1, raw_message.size(), log_file);
     }
+
+private:
+    void Open() {
+        if (verbosity == Log::SILENT) {
+            // nothing will ever be written, so don't spend a file handle on it (matters with thousands of traders)
+            return;
+        }
+        //keep file open since we log frequently
+        log_file = std::fopen (("logs/" + name + "_log.txt").c_str(), "w");
+        std::fwrite("# Log file\n", 1, 11, log_file);
+    }
 };
 
 #endif//CPPBAZAARBOT_LOGGER_H
@@ -6,31 +6,11 @@
 #define CPPBAZAARBOT_METRICS_H
 
 #include "../traders/AI_trader.h"
-# include <regex>
+#include "../common/ring_buffer.h"
 #include <fstream>
 
 class PlayerTrader;
 
-namespace {
-    // SRC: https://www.jeremymorgan.com/tutorials/c-programming/how-to-capture-the-output-of-a-linux-command-in-c/
-    std::string GetStdoutFromCommand(std::string cmd) {
-        std::string data;
-        FILE * stream;
-        const int max_buffer = 256;
-        char buffer[max_buffer];
-        cmd.append(" 2>&1");
-
-        stream = popen(cmd.c_str(), "r");
-
-        if (stream) {
-            while (!feof(stream))
-                if (fgets(buffer, max_buffer, stream) != NULL) data.append(buffer);
-            pclose(stream);
-        }
-        return data;
-    }
-}
-
 // Intended to be stored in-memory, this lightweight metric tracker is for human player UI purposes
 class LocalMetrics {
 public:
@@ -74,7 +54,63 @@ public:
     }
 };
 
+// Bounded record of a whole run: once full, neighbouring points are averaged together and the sampling
+// stride doubles, so memory stays fixed however long the run lasts
+class DownsampledSeries {
+private:
+    std::vector<std::pair<double, double>> points;
+    std::size_t max_points;
+    int stride = 1;
+    int num_pending = 0;
+    std::pair<double, double> pending_total = {0, 0};
+public:
+    explicit DownsampledSeries(std::size_t max_points = 2048)
+        : max_points(std::max<std::size_t>(2, max_points - max_points % 2)) {
+        points.reserve(this->max_points);
+    }
+
+    void add(double time, double value) {
+        pending_total.first += time;
+        pending_total.second += value;
+        num_pending++;
+        if (num_pending < stride) {
+            return;
+        }
+        points.emplace_back(pending_total.first/num_pending, pending_total.second/num_pending);
+        pending_total = {0, 0};
+        num_pending = 0;
+        if (points.size() == max_points) {
+            for (std::size_t i = 0; i < max_points/2; i++) {
+                points[i] = {(points[2*i].first + points[2*i + 1].first)/2, (points[2*i].second + points[2*i + 1].second)/2};
+            }
+            points.resize(max_points/2);
+            stride *= 2;
+        }
+    }
+
+    const std::vector<std::pair<double, double>>& get() const { return points; }
+};
+
+// Running average of the samples collected since the last datafile write
+struct PendingAverage {
+    double total_time_s = 0;
+    double total_value = 0;
+    int num = 0;
+
+    void add(double time_s, double value) {
+        total_time_s += time_s;
+        total_value += value;
+        num++;
+    }
+    void reset() {
+        total_time_s = 0;
+        total_value = 0;
+        num = 0;
+    }
+};
+
 // Intended to be stored serverside, this produces datafiles on-disk which can be checked for debugging/analysis purposes
+// In-memory metrics are bounded: recent samples are kept in ring buffers, and the whole run is kept downsampled.
 class GlobalMetrics {
 public:
     std::vector<std::string> tracked_goods;
@@ -83,23 +119,31 @@ public:
     double avg_overall_age = 0;
     std::map<std::string, int> deaths_per_class;
     std::map<std::string, double> age_per_class;
-    std::map<std::string, std::vector<std::pair<double, double>>> avg_price_metrics;
 
     double avg_lifespan = 0;
 
 private:
+    static constexpr std::size_t RECENT_CAPACITY = 4096;   //~40s of samples @ 10ms driver step
+    static constexpr std::size_t FULL_RUN_CAPACITY = 2048;
+
     std::string folder = "global_tmp/";
     std::shared_ptr<std::mutex> file_mutex;
+    std::mutex series_mutex;    // guards avg_price_metrics and full_run_prices against readers on the display thread
     int curr_tick = 0;
     std::uint64_t offset;
     std::uint64_t start_time;
 
-    std::map<std::string, std::vector<std::pair<double, double>>> net_supply_metrics;
-    std::map<std::string, std::vector<std::pair<double, double>>> avg_trades_metrics;
-    std::map<std::string, std::vector<std::pair<double, double>>> avg_asks_metrics;
-    std::map<std::string, std::vector<std::pair<double, double>>> avg_bids_metrics;
-    std::map<std::string, std::vector<std::pair<double, double>>> num_alive_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> avg_price_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> net_supply_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> avg_trades_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> avg_asks_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> avg_bids_metrics;
+    std::map<std::string, RingBuffer<std::pair<double, double>>> num_alive_metrics;
+
+    std::map<std::string, DownsampledSeries> full_run_prices;
+    std::map<std::string, PendingAverage> pending_prices;
 
+    // files are kept open for the whole run and appended to
     std::map<std::string, std::unique_ptr<std::ofstream>> data_files;
 
     int lookback = 1;
@@ -113,51 +157,55 @@ public:
         init_datafiles();
 
         for (auto& good : tracked_goods) {
-            net_supply_metrics[good] = {};
-            avg_price_metrics[good] = {};
-            avg_trades_metrics[good] = {};
-            avg_asks_metrics[good] = {};
-            avg_bids_metrics[good] = {};
+            net_supply_metrics.emplace(good, RECENT_CAPACITY);
+            avg_price_metrics.emplace(good, RECENT_CAPACITY);
+            avg_trades_metrics.emplace(good, RECENT_CAPACITY);
+            avg_asks_metrics.emplace(good, RECENT_CAPACITY);
+            avg_bids_metrics.emplace(good, RECENT_CAPACITY);
+            full_run_prices.emplace(good, FULL_RUN_CAPACITY);
+            pending_prices[good] = {};
         }
         for (auto& role : tracked_roles) {
-            num_alive_metrics[role] = {};
+            num_alive_metrics.emplace(role, RECENT_CAPACITY);
             age_per_class[role] = 0;
             deaths_per_class[role] = 0;
         }
     }
 
+    ~GlobalMetrics() {
+        std::lock_guard<std::mutex> lock(*file_mutex);
+        for (auto& item : data_files) {
+            item.second->flush();
+        }
+    }
+
     void init_datafiles() {
-        file_mutex->lock();
+        std::lock_guard<std::mutex> lock(*file_mutex);
         for (auto& good : tracked_goods) {
             data_files[good] = std::make_unique<std::ofstream>();
             data_files[good]->open((folder+good + ".dat").c_str(), std::ios::trunc);
-            *(data_files[good].get()) << "# raw data file for " << good << std::endl;
+            *(data_files[good].get()) << "# raw data file for " << good << "\n";
             *(data_files[good].get()) << "0 0\n";
+            data_files[good]->flush();
         }
-        file_mutex->unlock();
     }
-    void update_datafiles(std::uint64_t stop_time) {
-        file_mutex->lock();
+    // Appends the average of everything collected since the previous call
+    void update_datafiles() {
+        std::lock_guard<std::mutex> lock(*file_mutex);
         for (auto& item : data_files) {
-            item.second->close();
-            item.second->open((folder+item.first + ".dat").c_str(), std::ios::app);
-            int num = 0;
-            double total_value = 0;
-            double total_time_s = 0;
-            auto it = avg_price_metrics.at(item.first).rbegin();
-            while (it != avg_price_metrics.at(item.first).rend() && it->first >= stop_time/1000) {
-                total_value += it->second;
-                total_time_s += it->first;
-                num++;
-                it++;
-            }
-            if (num > 0) {
-                double avg_value = total_value/num;
-                double avg_time = total_time_s/num;
+            auto& pending = pending_prices[item.first];
+            if (pending.num > 0) {
+                double avg_value = pending.total_value/pending.num;
+                double avg_time = pending.total_time_s/pending.num;
                 *(item.second.get()) << avg_time << " " << avg_value << "\n";
+                item.second->flush();
+                {
+                    std::lock_guard<std::mutex> series_lock(series_mutex);
+                    full_run_prices.at(item.first).add(avg_time, avg_value);
+                }
             }
+            pending.reset();
         }
-        file_mutex->unlock();
     }
     void CollectMetrics(const std::shared_ptr<AuctionHouse>& auction_house) {
         auto local_curr_time = to_unix_timestamp_ms(std::chrono::system_clock::now());
@@ -168,24 +216,75 @@ public:
             double bids = auction_house->AverageHistoricalBids(good, lookback);
             double trades = auction_house->AverageHistoricalTrades(good, lookback);
 
-            avg_price_metrics[good].emplace_back(time_passed_s, price);
-            avg_trades_metrics[good].emplace_back(time_passed_s, trades);
-            avg_asks_metrics[good].emplace_back(time_passed_s, asks);
-            avg_bids_metrics[good].emplace_back(time_passed_s, bids);
+            {
+                std::lock_guard<std::mutex> lock(series_mutex);
+                avg_price_metrics.at(good).push_back({time_passed_s, price});
+            }
+            pending_prices[good].add(time_passed_s, price);
+            avg_trades_metrics.at(good).push_back({time_passed_s, trades});
+            avg_asks_metrics.at(good).push_back({time_passed_s, asks});
+            avg_bids_metrics.at(good).push_back({time_passed_s, bids});
 
-            net_supply_metrics[good].emplace_back(time_passed_s, asks-bids);
+            net_supply_metrics.at(good).push_back({time_passed_s, asks-bids});
         }
 
         auto res = auction_house->GetDemographics();
         avg_lifespan = res.first;
         auto demographics = res.second;
         for (auto& role : tracked_roles) {
-            num_alive_metrics[role].emplace_back(time_passed_s, demographics[role]);
+            num_alive_metrics.at(role).push_back({time_passed_s, (double) demographics[role]});
         }
 
         curr_tick++;
     }
 
+    // Copies the price history since start_s into output, reusing output's storage.
+    // Anything older than the recent buffer is taken from the downsampled full-run series.
+    void CopyPriceHistory(const std::string& good, double start_s, std::vector<std::pair<double, double>>& output) {
+        output.clear();
+        std::lock_guard<std::mutex> lock(series_mutex);
+        auto res = avg_price_metrics.find(good);
+        if (res == avg_price_metrics.end()) {
+            return;
+        }
+        auto& recent = res->second;
+        if (recent.empty()) {
+            return;
+        }
+
+        if (start_s < recent.front().first) {
+            for (auto& point : full_run_prices.at(good).get()) {
+                if (point.first >= recent.front().first) {
+                    break;
+                }
+                if (point.first >= start_s || output.empty()) {
+                    output.push_back(point);
+                } else {
+                    output.back() = point;
+                }
+            }
+        }
+
+        // binary search for the first recent point inside the window
+        std::size_t lo = 0;
+        std::size_t hi = recent.size();
+        while (lo < hi) {
+            std::size_t mid = (lo + hi)/2;
+            if (recent[mid].first < start_s) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        // include one point before the window so the line reaches the left edge
+        if (lo > 0 && output.empty()) {
+            lo--;
+        }
+        for (std::size_t i = lo; i < recent.size(); i++) {
+            output.push_back(recent[i]);
+        }
+    }
+
     void TrackDeath(const std::string& class_name, int age) {
         avg_overall_age = (avg_overall_age*total_deaths + age)/(total_deaths+1);
         total_deaths++;
@@ -0,0 +1,95 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_ORDER_LATENCY_H
+#define CPPBAZAARBOT_ORDER_LATENCY_H
+
+#include <map>
+#include <memory>
+#include <shared_mutex>
+
+#include "latency.h"
+#include "../common/messages.h"
+
+// Distributions of the time orders spend between consecutive lifecycle stages
+struct OrderStageHistograms {
+    LatencyHistogram outbox_wait;      // sent     -> arrived   (queued in the trader's outbox)
+    LatencyHistogram inbox_wait;       // arrived  -> booked    (queued in the AH inbox)
+    LatencyHistogram book_wait;        // booked   -> resolved  (waiting for the next AH tick)
+    LatencyHistogram time_to_fill;     // resolved -> filled
+    LatencyHistogram fill_to_close;    // filled   -> closed
+    LatencyHistogram result_delivery;  // closed   -> processed (AH outbox + trader inbox)
+    LatencyHistogram end_to_end;       // sent     -> processed
+
+    explicit OrderStageHistograms(const std::string& prefix)
+        : outbox_wait(prefix + " outbox wait")
+        , inbox_wait(prefix + " inbox wait")
+        , book_wait(prefix + " book wait")
+        , time_to_fill(prefix + " time to fill")
+        , fill_to_close(prefix + " fill to close")
+        , result_delivery(prefix + " result delivery")
+        , end_to_end(prefix + " end to end") {};
+
+    std::string Summary() const {
+        std::string output;
+        for (auto* histogram : {&outbox_wait, &inbox_wait, &book_wait, &time_to_fill, &fill_to_close, &result_delivery, &end_to_end}) {
+            if (histogram->Count() > 0) {
+                output.append(histogram->Summary()).append("\n");
+            }
+        }
+        return output;
+    }
+};
+
+// Aggregates order lifecycle latencies per commodity. Safe to record into from any number of traders at once.
+class OrderLifecycleTracker {
+private:
+    mutable std::shared_mutex mutex;
+    std::map<std::string, std::unique_ptr<OrderStageHistograms>> per_commodity;
+
+    static void RecordStage(LatencyHistogram& histogram, std::int64_t from_ns, std::int64_t to_ns) {
+        if (from_ns > 0 && to_ns >= from_ns) {
+            histogram.Record(to_ns - from_ns);
+        }
+    }
+
+public:
+    OrderStageHistograms& Get(const std::string& commodity) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto res = per_commodity.find(commodity);
+            if (res != per_commodity.end()) {
+                return *res->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto& entry = per_commodity[commodity];
+        if (!entry) {
+            entry = std::make_unique<OrderStageHistograms>(commodity);
+        }
+        return *entry;
+    }
+
+    void Record(const std::string& commodity, const OrderTimestamps& stamps, std::int64_t processed_ns) {
+        auto& stages = Get(commodity);
+        RecordStage(stages.outbox_wait, stamps.sent_ns, stamps.arrived_ns);
+        RecordStage(stages.inbox_wait, stamps.arrived_ns, stamps.booked_ns);
+        RecordStage(stages.book_wait, stamps.booked_ns, stamps.resolved_ns);
+        RecordStage(stages.time_to_fill, stamps.resolved_ns, stamps.filled_ns);
+        RecordStage(stages.fill_to_close, stamps.filled_ns, stamps.closed_ns);
+        RecordStage(stages.result_delivery, stamps.closed_ns, processed_ns);
+        RecordStage(stages.end_to_end, stamps.sent_ns, processed_ns);
+    }
+
+    std::string Summary() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::string output;
+        for (auto& item : per_commodity) {
+            output.append(item.second->Summary());
+        }
+        return output;
+    }
+};
+
+#endif//CPPBAZAARBOT_ORDER_LATENCY_H
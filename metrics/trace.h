@@ -0,0 +1,228 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_TRACE_H
+#define CPPBAZAARBOT_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../common/concurrency.h"
+
+namespace Trace {
+    enum EventType {
+        SPAN,
+        COUNTER
+    };
+}
+
+struct TraceEvent {
+    std::atomic<bool> ready{false};     // set once the event is fully written
+    Trace::EventType type = Trace::SPAN;
+    std::uint32_t tid = 0;
+    std::int64_t start_ns = 0;
+    std::int64_t duration_ns = 0;
+    double value = 0;
+    const char* name = "";              // must be a string literal (or otherwise outlive the recorder)
+    char detail[24] = {};               // copied, eg the commodity for a ResolveOffers span
+};
+
+// Opt-in recorder for Chrome/Perfetto trace-event JSON (open the output in chrome://tracing or ui.perfetto.dev).
+// The event buffer is allocated and touched once in Enable(), and recording is a single atomic increment plus a
+// few stores, so tracing does not allocate or lock on the hot path. Once the buffer is full, further events are
+// counted and dropped.
+class TraceRecorder {
+private:
+    std::atomic<bool> enabled{false};
+    std::unique_ptr<TraceEvent[]> events;
+    std::size_t capacity = 0;
+    std::atomic<std::size_t> next_event{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::int64_t origin_ns = 0;
+
+    std::atomic<std::uint32_t> next_tid{1};
+    std::mutex thread_names_mutex;
+    std::vector<std::pair<std::uint32_t, std::string>> thread_names;
+
+    TraceEvent* Claim() {
+        auto index = next_event.fetch_add(1, std::memory_order_relaxed);
+        if (index >= capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &events[index];
+    }
+
+    static void CopyDetail(TraceEvent& event, const char* detail) {
+        if (detail) {
+            std::strncpy(event.detail, detail, sizeof(event.detail) - 1);
+        }
+    }
+
+    static void WriteEscaped(FILE* file, const char* text) {
+        for (const char* c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                std::fputc('\\', file);
+            }
+            std::fputc(*c, file);
+        }
+    }
+
+public:
+    static TraceRecorder& Global() {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    bool Enabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Enable(std::size_t max_events = 1 << 20) {
+        events = std::make_unique<TraceEvent[]>(max_events);
+        capacity = max_events;
+        next_event = 0;
+        dropped = 0;
+        origin_ns = monotonic_ns();
+        enabled = true;
+    }
+
+    void Disable() {
+        enabled = false;
+    }
+
+    std::uint64_t NumDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    // Small sequential ids read better in trace viewers than hashed std::thread::ids
+    std::uint32_t ThreadId() {
+        thread_local std::uint32_t tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+        return tid;
+    }
+
+    void NameThread(const std::string& name) {
+        if (!Enabled()) {
+            return;
+        }
+        auto tid = ThreadId();
+        std::lock_guard<std::mutex> lock(thread_names_mutex);
+        thread_names.emplace_back(tid, name);
+    }
+
+    void Span(const char* name, const char* detail, std::int64_t start_ns, std::int64_t end_ns) {
+        auto* event = Claim();
+        if (!event) {
+            return;
+        }
+        event->type = Trace::SPAN;
+        event->tid = ThreadId();
+        event->start_ns = start_ns;
+        event->duration_ns = end_ns - start_ns;
+        event->name = name;
+        CopyDetail(*event, detail);
+        event->ready.store(true, std::memory_order_release);
+    }
+
+    // Counter tracks are grouped by name; series distinguishes several values on one track (eg per commodity)
+    void Counter(const char* name, const char* series, double value) {
+        if (!Enabled()) {
+            return;
+        }
+        auto* event = Claim();
+        if (!event) {
+            return;
+        }
+        event->type = Trace::COUNTER;
+        event->tid = ThreadId();
+        event->start_ns = monotonic_ns();
+        event->value = value;
+        event->name = name;
+        CopyDetail(*event, series);
+        event->ready.store(true, std::memory_order_release);
+    }
+
+    // Events still being written by other threads are skipped, so call Disable() and stop workers first if possible
+    bool WriteJson(const std::string& path) {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> lock(thread_names_mutex);
+            for (auto& item : thread_names) {
+                std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", item.first);
+                WriteEscaped(file, item.second.c_str());
+                std::fputs("\"}}", file);
+                first = false;
+            }
+        }
+        auto num_events = std::min(next_event.load(), capacity);
+        for (std::size_t i = 0; i < num_events; i++) {
+            auto& event = events[i];
+            if (!event.ready.load(std::memory_order_acquire)) {
+                continue;
+            }
+            double ts_us = (event.start_ns - origin_ns) / 1e3;
+            std::fputs(first ? "" : ",\n", file);
+            first = false;
+            std::fputs("{\"name\":\"", file);
+            WriteEscaped(file, event.name);
+            if (event.type == Trace::SPAN) {
+                std::fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", event.tid, ts_us, event.duration_ns / 1e3);
+                if (event.detail[0]) {
+                    std::fputs(",\"args\":{\"detail\":\"", file);
+                    WriteEscaped(file, event.detail);
+                    std::fputs("\"}", file);
+                }
+                std::fputs("}", file);
+            } else {
+                std::fprintf(file, "\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"", event.tid, ts_us);
+                WriteEscaped(file, event.detail[0] ? event.detail : "value");
+                std::fprintf(file, "\":%g}}", event.value);
+            }
+        }
+        std::fputs("\n]}\n", file);
+        std::fclose(file);
+        return true;
+    }
+};
+
+// Records the enclosing scope as a span when tracing is enabled; otherwise costs one relaxed load
+class TraceSpan {
+private:
+    const char* name;
+    const char* detail;
+    std::int64_t start_ns = 0;
+    bool active;
+public:
+    explicit TraceSpan(const char* name, const char* detail = nullptr)
+        : name(name)
+        , detail(detail)
+        , active(TraceRecorder::Global().Enabled()) {
+        if (active) {
+            start_ns = monotonic_ns();
+        }
+    }
+    ~TraceSpan() {
+        if (active) {
+            TraceRecorder::Global().Span(name, detail, start_ns, monotonic_ns());
+        }
+    }
+    // Drop this span, eg for a mailbox flush that turned out to be empty
+    void Discard() {
+        active = false;
+    }
+};
+
+#endif//CPPBAZAARBOT_TRACE_H
@@ -6,6 +6,8 @@
 #include "common/agent.h"
 #include "common/messages.h"
 #include "common/commodity.h"
+#include "common/economy.h"
+#include "common/rng.h"
 
 #include "traders/inventory.h"
 
@@ -19,6 +21,7 @@
 #include "traders/fake_trader.h"
 #include "traders/human_trader.h"
 #include "traders/roles.h"
+#include "traders/trader_pool.h"
 
 std::shared_ptr<AITrader> CreateAndRegister(int id,
                                                const std::shared_ptr<AuctionHouse>& auction_house,
@@ -37,7 +40,73 @@ std::shared_ptr<AITrader> CreateAndRegister(int id,
     return trader;
 }
 
-int RandomChoice(int num_weights, std::vector<double>& weights, std::mt19937& gen) {
+// A new trader of the given role with randomised starting money and minimum cost, or nullopt for a bad role id
+std::optional<TraderSpec> MakeAgentSpec(const Economy& economy, int role_id, int curr_id, Rng& gen) {
+    double STARTING_MONEY = 500.0;
+    double MIN_COST = 10;
+    std::uniform_real_distribution<> random_money(0.5*STARTING_MONEY, 1.5*STARTING_MONEY); // define the range
+    std::uniform_real_distribution<> random_cost(0.9*MIN_COST, 1.1*MIN_COST); // define the range
+    if (role_id < 0 || role_id >= (int) economy.roles.size()) {
+        std::cout << "Error: Invalid role id passed to MakeAgent" << std::endl;
+        return std::nullopt;
+    }
+    auto& role = economy.roles[role_id];
+    auto logic = std::make_shared<RecipeRole>(role.program, random_cost(gen), role.fulfillment_floor);
+    return TraderSpec{curr_id, std::move(logic), role.name, random_money(gen), 20, role.inventory};
+}
+
+std::shared_ptr<AITrader> MakeAgent(const Economy& economy, int role_id, int curr_id,
+                                    std::shared_ptr<AuctionHouse>& auction_house,
+                                    Rng& gen, int tick_time_ms, Log::LogLevel LOGLEVEL) {
+    auto spec = MakeAgentSpec(economy, role_id, curr_id, gen);
+    if (!spec) {
+        return std::shared_ptr<AITrader>();
+    }
+    return CreateAndRegister(spec->id, auction_house, spec->logic, spec->name, spec->starting_money, spec->inv_capacity, spec->inventory, tick_time_ms, LOGLEVEL);
+}
+
+// As above, but the trader comes from (and is ticked by) the pool
+std::shared_ptr<AITrader> MakeAgent(const Economy& economy, int role_id, int curr_id, TraderPool& pool, Rng& gen) {
+    auto spec = MakeAgentSpec(economy, role_id, curr_id, gen);
+    if (!spec) {
+        return std::shared_ptr<AITrader>();
+    }
+    return pool.Spawn(*spec);
+}
+
+// One trader per entry of role_ids, registered in bulk, with ids from next_id upwards. Bad role ids are skipped.
+// The traders aren't ticking yet: start a thread on AITrader::Tick for each.
+std::vector<std::shared_ptr<AITrader>> MakeAgents(const Economy& economy, const std::vector<int>& role_ids, int& next_id,
+                                                  std::shared_ptr<AuctionHouse>& auction_house,
+                                                  Rng& gen, int tick_time_ms, Log::LogLevel LOGLEVEL) {
+    std::vector<std::shared_ptr<AITrader>> traders;
+    traders.reserve(role_ids.size());
+    for (int role_id : role_ids) {
+        auto spec = MakeAgentSpec(economy, role_id, next_id, gen);
+        if (spec) {
+            traders.push_back(std::make_shared<AITrader>(spec->id, auction_house, spec->logic, spec->name, spec->starting_money, spec->inv_capacity, spec->inventory, tick_time_ms, LOGLEVEL));
+            next_id++;
+        }
+    }
+    auction_house->RegisterTraders(traders);
+    return traders;
+}
+
+// As above, but the traders come from (and are already ticked by) the pool
+std::vector<std::shared_ptr<AITrader>> MakeAgents(const Economy& economy, const std::vector<int>& role_ids, int& next_id, TraderPool& pool, Rng& gen) {
+    std::vector<TraderSpec> specs;
+    specs.reserve(role_ids.size());
+    for (int role_id : role_ids) {
+        auto spec = MakeAgentSpec(economy, role_id, next_id, gen);
+        if (spec) {
+            specs.push_back(std::move(*spec));
+            next_id++;
+        }
+    }
+    return pool.SpawnBatch(specs);
+}
+
+int RandomChoice(int num_weights, std::vector<double>& weights, Rng& gen) {
     double sum_of_weight = 0;
     for(int i=0; i<num_weights; i++) {
         sum_of_weight += weights[i];
@@ -52,35 +121,116 @@ int RandomChoice(int num_weights, std::vector<double>& weights, std::mt19937& ge
     return -1;
 }
 
-std::string GetProducer(std::string& commodity) {
-    if (commodity == "food") {
-        return "farmer";
-    } else if (commodity == "fertilizer") {
-        return "composter";
-    } else if (commodity == "wood") {
-        return "woodcutter";
-    } else if (commodity == "ore") {
-        return "miner";
-    } else if (commodity == "metal") {
-        return "refiner";
-    } else if (commodity == "tools") {
-        return "blacksmith";
-    } else {
-        return "null";
+// Saves the whole market: the auction house (ledger, history and books) and every trader it still has registered.
+// Requires the auction house and traders to be stopped, eg after AuctionHouse::Shutdown() and TraderPool::Shutdown().
+// Results in flight at that point are lost, so a resting order is only kept if its book and its trader both know of
+// it; that way restored traders and books always agree.
+bool WriteCheckpoint(const std::string& path, AuctionHouse& auction_house, const std::vector<std::shared_ptr<AITrader>>& traders) {
+    CheckpointWriter out(path);
+    if (!out.ok()) {
+        std::cout << "Error: Failed to open checkpoint " << path << " for writing" << std::endl;
+        return false;
     }
+    out.Write(to_unix_timestamp_ms(std::chrono::system_clock::now()));
+
+    auto in_book = auction_house.RestingOrders();
+    std::unordered_set<std::uint64_t> keep_orders;
+    std::vector<TraderCheckpoint> checkpoints;
+    for (auto& trader : traders) {
+        if (!auction_house.IsRegistered(trader->id)) {
+            continue;
+        }
+        // keeps its message thread from applying results while we copy it
+        trader->Park();
+        auto checkpoint = trader->Checkpoint();
+        trader->Unpark();
+        // The book is what gets restored, so it has the final say. Cancels and amends the trader sent that are still
+        // in intake are lost, and the trader's view is rolled back to match: otherwise an order left marked as
+        // cancelling would block that side of its commodity for good.
+        for (auto* resting : {&checkpoint.resting_bids, &checkpoint.resting_asks}) {
+            resting->erase(std::remove_if(resting->begin(), resting->end(), [&in_book] (const std::pair<std::string, RestingOrder>& order) {
+                return in_book.count(order.second.order_id) == 0;
+            }), resting->end());
+            for (auto& [commodity, order] : *resting) {
+                auto& [quantity, unit_price] = in_book.at(order.order_id);
+                order.quantity = quantity;
+                order.unit_price = unit_price;
+                order.cancelling = false;
+                keep_orders.insert(order.order_id);
+            }
+        }
+        checkpoints.push_back(std::move(checkpoint));
+    }
+    auction_house.Save(out, keep_orders);
+    out.Section(Checkpoint::TRADERS);
+    out.Write((std::uint32_t) checkpoints.size());
+    for (auto& checkpoint : checkpoints) {
+        checkpoint.Save(out);
+    }
+    if (!out.Finish()) {
+        std::cout << "Error: Failed to write checkpoint " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Loads a checkpoint into a fresh auction house (with the same commodities registered, and not yet ticking) and
+// brings its traders back through the pool under their saved ids. History timestamps and order expiries are moved
+// on by however long ago the checkpoint was written. Returns the first unused trader id, or nullopt on failure.
+std::optional<int> RestoreCheckpoint(const std::string& path, const Economy& economy, AuctionHouse& auction_house, TraderPool& pool) {
+    CheckpointReader in(path);
+    auto saved_ms = in.Read<std::int64_t>();
+    if (!in.ok()) {
+        return std::nullopt;
+    }
+    if (!auction_house.Restore(in, to_unix_timestamp_ms(std::chrono::system_clock::now()) - saved_ms)) {
+        return std::nullopt;
+    }
+    if (!in.Section(Checkpoint::TRADERS, "traders")) {
+        return std::nullopt;
+    }
+    std::vector<TraderCheckpoint> checkpoints;
+    auto num_traders = in.Read<std::uint32_t>();
+    for (std::uint32_t i = 0; i < num_traders && in.ok(); i++) {
+        checkpoints.push_back(TraderCheckpoint::Load(in, AITrader::INTERNAL_LOOKBACK));
+    }
+    if (!in.Section(Checkpoint::END, "end")) {
+        return std::nullopt;
+    }
+
+    std::vector<TraderSpec> specs;
+    int next_id = auction_house.id + 1;
+    for (auto& checkpoint : checkpoints) {
+        int role_id = economy.RoleId(checkpoint.class_name);
+        if (role_id < 0) {
+            in.Fail("unknown role " + checkpoint.class_name);
+            return std::nullopt;
+        }
+        auto& role = economy.roles[role_id];
+        auto logic = std::make_shared<RecipeRole>(role.program, checkpoint.min_cost, role.fulfillment_floor);
+        specs.push_back({checkpoint.id, std::move(logic), role.name, checkpoint.money, checkpoint.inv_capacity, checkpoint.inventory});
+        next_id = std::max(next_id, checkpoint.id + 1);
+    }
+    pool.SpawnBatch(specs, [&checkpoints] (std::size_t i, AITrader& trader) {
+        trader.Restore(checkpoints[i]);
+    });
+    return next_id;
 }
-std::string ChooseNewClassWeighted(std::vector<std::string>& tracked_goods, std::shared_ptr<AuctionHouse>& auction_house, std::mt19937& gen) {
+
+// Picks a role to spawn, favouring the producers of commodities in short supply. Returns a role id, or -1 if the
+// chosen commodity has no producer.
+int ChooseNewClassWeighted(const Economy& economy, std::shared_ptr<AuctionHouse>& auction_house, Rng& gen) {
     std::vector<double> weights;
     double gamma = -0.02;
     //auction house ticks at 10ms
     int lookback_time_ms = 1000;
-    for (auto& commodity : tracked_goods) {
-        double supply = auction_house->t_AverageHistoricalSupply(commodity, lookback_time_ms);
+    for (auto& commodity : economy.commodities) {
+        double supply = auction_house->t_AverageHistoricalSupply(commodity.name, lookback_time_ms);
 //        double supply = auction_house->AverageHistoricalAsks(commodity, 100) - auction_house->AverageHistoricalBids(commodity, 100);
         weights.push_back(std::exp(gamma*supply));
     }
     int choice = RandomChoice((int) weights.size(),  weights, gen);
-    return GetProducer(tracked_goods[choice]);
+    return (choice < 0) ? -1 : economy.producer[choice];
 }
 
 
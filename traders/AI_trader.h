@@ -8,13 +8,37 @@
 #include <utility>
 
 #include "inventory.h"
+#include "price_model.h"
+#include "../common/rng.h"
+#include "../common/checkpoint.h"
 #include "../common/messages.h"
 
 #include "../auction/auction_house.h"
 #include "../metrics/logger.h"
+#include "../metrics/order_latency.h"
+#include "../metrics/trace.h"
 
 class AITrader;
 
+// Phase timings shared by every AI trader, readable at runtime from any thread
+struct TraderTimings {
+    LatencyHistogram tick{"Trader tick"};
+    LatencyHistogram tick_role{"Trader TickRole"};
+    LatencyHistogram generate_offers{"Trader GenerateOffers"};
+    std::atomic<std::uint64_t> offers_held_back{0};    // ticks spent not quoting because the AH was backed up
+    std::atomic<std::uint64_t> amends_coalesced{0};    // amends that overwrote an undelivered one for the same order
+
+    std::string Summary() const {
+        std::string output;
+        for (auto* histogram : {&tick, &tick_role, &generate_offers}) {
+            output.append(histogram->Summary()).append("\n");
+        }
+        output.append("Trader backpressure: " + std::to_string(offers_held_back.load()) + " ticks held back, "
+                      + std::to_string(amends_coalesced.load()) + " amends coalesced\n");
+        return output;
+    }
+};
+
 namespace {
     double PositionInRange(double value, double min, double max) {
         value -= min;
@@ -30,35 +54,145 @@ namespace {
 }
 
 class Role {
-private:
-    // rng_gen
-    std::mersenne_twister_engine<uint_fast32_t, 32, 624, 397, 31, 0x9908b0dfUL, 11, 0xffffffffUL, 7, 0x9d2c5680UL, 15, 0xefc60000UL, 18, 1812433253UL> rng_gen = std::mt19937(std::random_device()());
-
 public:
     std::string required_good;
-    Role(std::string required = "none", double min_cost = 1) : required_good(required), min_cost(min_cost){};
-    bool Random(double chance);
+    Role(std::string required = "none", double min_cost = 1, double fulfillment_floor = 0) : required_good(required), min_cost(min_cost), fulfillment_floor(fulfillment_floor){};
+    // Draws from the trader's stream, so a role carries no RNG state of its own
+    bool Random(AITrader & trader, double chance);
     virtual void TickRole(AITrader & trader) = 0;
     void Produce(AITrader & trader, const std::string& commodity, int amount, double chance = 1);
     void Consume(AITrader & trader, const std::string& commodity, int amount, double chance = 1);
+    // By inventory id (see AITrader::FindItem), for roles that look their commodities up once
+    void Produce(AITrader & trader, int item, int amount, double chance = 1);
+    void Consume(AITrader & trader, int item, int amount, double chance = 1);
     void LoseMoney(AITrader & trader, double amount);
     double track_costs = 0;
     double min_cost; //minimum fair price for a single produced good
+    double fulfillment_floor; //bids treat stock below this share of the ideal quantity as this share
+};
+
+
+// An order this trader has resting in the book. order_id is 0 until the auction house acknowledges it.
+struct RestingOrder {
+    std::uint64_t order_id = 0;
+    int quantity = 0;
+    double unit_price = 0;
+    bool cancelling = false;
 };
 
+// Everything about an AITrader that a checkpoint keeps
+struct TraderCheckpoint {
+    int id = 0;
+    int ticks = 0;
+    std::string class_name;
+    double money = 0;
+    double min_cost = 0;            // of its role
+    double track_costs = 0;
+    double inv_capacity = 0;
+    std::vector<InventoryItem> inventory;                           // by inventory id
+    std::vector<std::vector<std::pair<double, int>>> trading_ranges;  // by inventory id, see TradingRange::Entries
+    Rng rng;
+    std::vector<std::pair<std::string, RestingOrder>> resting_bids;
+    std::vector<std::pair<std::string, RestingOrder>> resting_asks;
+
+    void Save(CheckpointWriter& out) const {
+        out.Write(id);
+        out.Write(ticks);
+        out.WriteString(class_name);
+        out.Write(money);
+        out.Write(min_cost);
+        out.Write(track_costs);
+        out.Write(inv_capacity);
+        out.Write((std::uint32_t) inventory.size());
+        for (std::size_t item = 0; item < inventory.size(); item++) {
+            out.WriteString(inventory[item].name);
+            out.Write(inventory[item].stored);
+            out.Write(inventory[item].ideal_quantity);
+            out.Write(inventory[item].original_cost);
+            out.Write(inventory[item].size);
+            out.Write((std::uint32_t) trading_ranges[item].size());
+            for (auto& entry : trading_ranges[item]) {
+                out.Write(entry.first);
+                out.Write(entry.second);
+            }
+        }
+        out.Write(rng);
+        for (auto* resting : {&resting_bids, &resting_asks}) {
+            out.Write((std::uint32_t) resting->size());
+            for (auto& [commodity, order] : *resting) {
+                out.WriteString(commodity);
+                out.Write(order.order_id);
+                out.Write(order.quantity);
+                out.Write(order.unit_price);
+                out.Write(order.cancelling);
+            }
+        }
+    }
+
+    // range_capacity bounds each trading range, see TradingRange
+    static TraderCheckpoint Load(CheckpointReader& in, std::uint32_t range_capacity) {
+        TraderCheckpoint checkpoint;
+        checkpoint.id = in.Read<int>();
+        checkpoint.ticks = in.Read<int>();
+        checkpoint.class_name = in.ReadString();
+        checkpoint.money = in.Read<double>();
+        checkpoint.min_cost = in.Read<double>();
+        checkpoint.track_costs = in.Read<double>();
+        checkpoint.inv_capacity = in.Read<double>();
+        auto num_items = in.Read<std::uint32_t>();
+        for (std::uint32_t item = 0; item < num_items && in.ok(); item++) {
+            InventoryItem entry(in.ReadString());
+            entry.stored = in.Read<int>();
+            entry.ideal_quantity = in.Read<int>();
+            entry.original_cost = in.Read<double>();
+            entry.size = in.Read<double>();
+            checkpoint.inventory.push_back(entry);
+            auto num_entries = in.Read<std::uint32_t>();
+            if (num_entries > range_capacity) {
+                in.Fail("corrupt trading range");
+                break;
+            }
+            auto& range = checkpoint.trading_ranges.emplace_back(num_entries);
+            for (auto& range_entry : range) {
+                range_entry.first = in.Read<double>();
+                range_entry.second = in.Read<int>();
+            }
+        }
+        checkpoint.rng = in.Read<Rng>();
+        for (auto* resting : {&checkpoint.resting_bids, &checkpoint.resting_asks}) {
+            auto num_orders = in.Read<std::uint32_t>();
+            for (std::uint32_t i = 0; i < num_orders && in.ok(); i++) {
+                auto commodity = in.ReadString();
+                RestingOrder order;
+                order.order_id = in.Read<std::uint64_t>();
+                order.quantity = in.Read<int>();
+                order.unit_price = in.Read<double>();
+                order.cancelling = in.Read<bool>();
+                resting->emplace_back(commodity, order);
+            }
+        }
+        return checkpoint;
+    }
+};
 
 class AITrader : public Trader {
 private:
     std::atomic<bool> queue_active = true;
     std::thread message_thread;
+    // Held by the message thread while it flushes; it skips flushing while parked (see Park())
+    std::mutex message_mutex;
+    std::atomic<bool> parked = false;
 
     std::string unique_name;
     
     int TICK_TIME_MS;
 
-    int MAX_PROCESSED_MESSAGES_PER_FLUSH = 100;
+    // Flow control (see AuctionHouse::Load). Past BACKOFF_LOAD we skip quoting on a growing share of ticks, and not
+    // at all while the AH is refusing what we've already sent (backlogged).
+    double BACKOFF_LOAD = 0.5;
+    std::atomic<bool> backlogged = false;
     friend Role;
-    std::mt19937 rng_gen = std::mt19937(std::random_device()());
+    Rng rng_gen = Rng::Stream(id);
     double MIN_PRICE = 0.10;
     bool ready = false;
 
@@ -68,18 +202,40 @@ private:
     std::weak_ptr<AuctionHouse> auction_house;
     int auction_house_id = -1;
 
-    std::map<std::string, std::vector<double>> observed_trading_range;
+    // per inventory id, the prices we've recently traded at
+    std::mutex price_model_mutex;
+    std::vector<TradingRange> observed_trading_range;
 
     int  external_lookback = 50*TICK_TIME_MS; //history range (num ticks)
-    int internal_lookback = 50; //history range (num trades)
+    int internal_lookback = INTERNAL_LOOKBACK;
 
     double IDLE_TAX = 20;
+    double AMEND_THRESHOLD = 0.05; //relative price change worth amending a resting order for
+    double QUANTITY_AMEND_THRESHOLD = 0.5; //relative growth in quantity worth amending for (any cut is amended)
+
+    // Per inventory id, the band our current ask price was drawn from and the price drawn. The ask keeps that price
+    // until the band itself moves, rather than drawing afresh (and so amending) every tick.
+    struct AskQuote {
+        double fair_price;
+        double market_price;
+        double price;
+    };
+    std::vector<std::optional<AskQuote>> ask_quotes;
+
+    // Offers rest until filled or cancelled; each tick we amend them rather than post new ones
+    std::mutex resting_mutex;
+    std::map<std::string, RestingOrder> resting_bids;
+    std::map<std::string, RestingOrder> resting_asks;
+
     FileLogger logger;
 
     double money;
 
 public:
+    static constexpr int INTERNAL_LOOKBACK = 50; //history range (num units traded)
     std::atomic<bool> destroyed = false;
+    static inline TraderTimings timings;
+    static inline OrderLifecycleTracker order_latency;
 
     AITrader(int id, std::weak_ptr<AuctionHouse> auction_house_ptr, std::optional<std::shared_ptr<Role>> AI_logic, const std::string& class_name, double starting_money, double inv_capacity, const std::vector<InventoryItem> &starting_inv, int tick_time_ms, Log::LogLevel verbosity = Log::WARN)
     : Trader(id, class_name)
@@ -89,26 +245,21 @@ public:
     , unique_name(class_name + std::to_string(id))
     , logger(FileLogger(verbosity, unique_name))
     , TICK_TIME_MS(tick_time_ms) {
-        //construct inv
         auction_house_id = auction_house.lock()->id;
-        _inventory = Inventory(inv_capacity, starting_inv);
-        for (const auto &item : starting_inv) {
-            double base_price = auction_house.lock()->t_AverageHistoricalPrice(item.name, external_lookback);
-            observed_trading_range[item.name] = {base_price*0.5, base_price*2};
-            _inventory.SetCost(item.name, base_price);
-        }
+        InitInventory(inv_capacity, starting_inv);
             message_thread = std::thread([this] { MessageLoop(); });
     }
 
     ~AITrader() {
         logger.Log(Log::DEBUG, "Destroying AI trader");
         ShutdownMessageThread();
-        _inventory.inventory.clear();
         auction_house.reset();
         logic.reset();
     }
 
 private:
+    void InitInventory(double inv_capacity, const std::vector<InventoryItem> &starting_inv);
+
     // MESSAGE PROCESSING
     void FlushOutbox();
     void FlushInbox();
@@ -116,19 +267,25 @@ private:
     void ProcessBidResult(Message& message);
     void ProcessAskResult(Message& message);
     void ProcessRegistrationResponse(Message& message);
+    void ProcessOrderAck(Message& message);
 
     void UpdatePriceModelFromBid(BidResult& result);
     void UpdatePriceModelFromAsk(const AskResult& result);
 
     // INTERNAL LOGIC
-    void GenerateOffers(const std::string& commodity);
-    BidOffer CreateBid(const std::string& commodity, int min_limit, int max_limit, double desperation = 0);
-    AskOffer CreateAsk(const std::string& commodity, int min_limit);
+    void GenerateOffers(int item);
+    BidOffer CreateBid(int item, int min_limit, int max_limit, double desperation = 0);
+    AskOffer CreateAsk(int item, int min_limit);
+    void PlaceBid(const std::string& commodity, std::optional<BidOffer> offer);
+    void PlaceAsk(const std::string& commodity, std::optional<AskOffer> offer);
+    bool WorthAmending(const RestingOrder& order, int quantity, double unit_price) const;
+    void SendAmend(AmendOrder amend);
+    bool HoldBackOffers();
 
-    int DetermineBuyQuantity(const std::string& commodity, double bid_price);
-    int DetermineSaleQuantity(const std::string& commodity);
+    int DetermineBuyQuantity(int item, double bid_price);
+    int DetermineSaleQuantity(int item);
 
-    std::pair<double, double> ObserveTradingRange(const std::string& commodity, int window);
+    std::pair<double, double> ObserveTradingRange(int item);
 
     void ShutdownMessageThread();
 public:
@@ -137,11 +294,27 @@ public:
     void TickOnce();
     void MessageLoop();
 
+    // CHECKPOINTS
+    // Requires the trader to be stopped or parked
+    TraderCheckpoint Checkpoint();
+    // Takes on a checkpointed trader's state. Requires a trader of the same id and role that isn't ticking yet.
+    void Restore(const TraderCheckpoint& checkpoint);
+
+    // RECYCLING (see TraderPool)
+    // Returns false if the message thread has already stopped for good, in which case the trader can't be reused
+    bool Park();
+    void Unpark();
+    // Turns a parked, dead trader into a brand new one. Only the threads, log file and allocations carry over.
+    void Reset(int new_id, std::optional<std::shared_ptr<Role>> AI_logic, const std::string& new_class_name, double starting_money, double inv_capacity, const std::vector<InventoryItem> &starting_inv);
+
 
 
     int GetIdeal(const std::string& name);
     int Query(const std::string& name);
     double QueryCost(const std::string& name);
+    // Inventory id of a commodity, -1 if we don't hold it. Fixed for the trader's lifetime.
+    int FindItem(const std::string& name) const { return _inventory.Find(name); }
+    int Query(int item) const { return (item < 0) ? 0 : _inventory.Query(item); }
 
     double GetIdleTax() { return IDLE_TAX;};
     double QueryMoney() { return money;};
@@ -157,40 +330,69 @@ protected:
 
     int TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) override;
     int TryAddCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) override;
+private:
+    int TryTakeItem(int item, int quantity, bool atomic);
+    int TryAddItem(int item, int quantity, std::optional<double> unit_price, bool atomic);
 };
 
+void AITrader::InitInventory(double inv_capacity, const std::vector<InventoryItem> &starting_inv) {
+    _inventory = Inventory(inv_capacity, starting_inv);
+    observed_trading_range.assign(_inventory.NumCommodities(), TradingRange(internal_lookback));
+    ask_quotes.assign(_inventory.NumCommodities(), std::nullopt);
+    for (int item = 0; item < _inventory.NumCommodities(); item++) {
+        double base_price = auction_house.lock()->t_AverageHistoricalPrice(_inventory.Name(item), external_lookback);
+        observed_trading_range[item].Record(base_price*0.5, 1);
+        observed_trading_range[item].Record(base_price*2, 1);
+        _inventory.SetCost(item, base_price);
+    }
+}
+
+// Sends until the outbox is empty or the AH refuses a message, which then waits at the front for the next flush
 void AITrader::FlushOutbox() {
-        logger.Log(Log::DEBUG, "Flushing outbox");
-        auto outgoing = outbox.pop();
-        int num_processed = 0;
-        while (outgoing && num_processed < MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-            // Trader can currently only talk to auction houses (not other traders)
-            if (outgoing->first != auction_house_id) {
-                logger.Log(Log::ERROR, "Failed to send message, unknown recipient " + std::to_string(outgoing->first));
-            } else {
-                logger.LogSent(outgoing->first, Log::DEBUG, outgoing->second.ToString());
-                auto res = auction_house.lock();
-                if (res) {
-                    res->ReceiveMessage(std::move(outgoing->second));
-                } else {
-                    queue_active = false;
-                    destroyed = true;
-                    return;
-                }
+    TraceSpan span("Trader FlushOutbox");
+    logger.Log(Log::DEBUG, "Flushing outbox");
+    int num_processed = 0;
+    bool refused = false;
+    while (auto outgoing = outbox.pop()) {
+        // Trader can currently only talk to auction houses (not other traders)
+        if (outgoing->first != auction_house_id) {
+            logger.Log(Log::ERROR, "Failed to send message, unknown recipient " + std::to_string(outgoing->first));
+        } else {
+            auto res = auction_house.lock();
+            if (!res) {
+                queue_active = false;
+                destroyed = true;
+                return;
             }
-            num_processed++;
-            outgoing = outbox.pop();
+            std::string description = logger.Enabled(Log::DEBUG) ? outgoing->second.ToString() : "";
+            outgoing->second.StampArrival(monotonic_ns());
+            if (outgoing->second.GetType() == Msg::REGISTER_REQUEST) {
+                // control traffic isn't subject to flow control
+                res->ReceiveMessage(std::move(outgoing->second));
+            } else if (!res->TryReceiveMessage(outgoing->second)) {
+                outbox.push_front(std::move(*outgoing));
+                refused = true;
+                break;
+            }
+            logger.LogSent(auction_house_id, Log::DEBUG, description);
         }
-    if (num_processed == MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-        logger.Log(Log::WARN, "Outbox not fully flushed");
+        num_processed++;
+    }
+    backlogged = refused;
+    if (refused) {
+        logger.Log(Log::INFO, "Auction house inbox full, holding " + std::to_string(outbox.size()) + " messages");
+    }
+    if (num_processed == 0) {
+        span.Discard();
     }
     logger.Log(Log::DEBUG, "Flush finished");
 }
 void AITrader::FlushInbox() {
+    TraceSpan span("Trader FlushInbox");
     logger.Log(Log::DEBUG, "Flushing inbox");
-    auto incoming_message = inbox.pop();
+    // Drained in full: what the AH sends us is bounded by the orders we have open with it
     int num_processed = 0;
-    while (incoming_message && num_processed < MAX_PROCESSED_MESSAGES_PER_FLUSH) {
+    while (auto incoming_message = inbox.pop()) {
         logger.LogReceived(incoming_message->sender_id, Log::INFO, incoming_message->ToString());
         if (incoming_message->GetType() == Msg::EMPTY) {
             //no-op
@@ -198,6 +400,8 @@ void AITrader::FlushInbox() {
             ProcessBidResult(*incoming_message);
         } else if (incoming_message->GetType() == Msg::ASK_RESULT) {
             ProcessAskResult(*incoming_message);
+        } else if (incoming_message->GetType() == Msg::ORDER_ACK) {
+            ProcessOrderAck(*incoming_message);
         } else if (incoming_message->GetType() == Msg::REGISTER_RESPONSE) {
             ProcessRegistrationResponse(*incoming_message);
         } else if (incoming_message->GetType() == Msg::SHUTDOWN_COMMAND) {
@@ -207,18 +411,61 @@ void AITrader::FlushInbox() {
             logger.Log(Log::ERROR, "Unknown/unsupported message type");
         }
         num_processed++;
-        incoming_message = inbox.pop();
     }
-    if (num_processed == MAX_PROCESSED_MESSAGES_PER_FLUSH) {
-        logger.Log(Log::WARN, "Inbox not fully flushed");
+    if (num_processed == 0) {
+        span.Discard();
     }
     logger.Log(Log::DEBUG, "Flush finished");
 }
 void AITrader::ProcessAskResult(Message& message) {
-    UpdatePriceModelFromAsk(*message.ask_result);
+    auto& result = *message.ask_result;
+    if (result.closed) {
+        order_latency.Record(result.commodity, result.timestamps, monotonic_ns());
+    }
+    UpdatePriceModelFromAsk(result);
+
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    auto resting = resting_asks.find(result.commodity);
+    if (resting != resting_asks.end() && resting->second.order_id == result.order_id) {
+        if (result.closed) {
+            resting_asks.erase(resting);
+        } else {
+            resting->second.quantity -= result.quantity_traded;
+        }
+    }
 }
 void AITrader::ProcessBidResult(Message& message) {
-    UpdatePriceModelFromBid(*message.bid_result);
+    auto& result = *message.bid_result;
+    if (result.closed) {
+        order_latency.Record(result.commodity, result.timestamps, monotonic_ns());
+    }
+    UpdatePriceModelFromBid(result);
+
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    auto resting = resting_bids.find(result.commodity);
+    if (resting != resting_bids.end() && resting->second.order_id == result.order_id) {
+        if (result.closed) {
+            resting_bids.erase(resting);
+        } else {
+            resting->second.quantity -= result.quantity_traded;
+        }
+    }
+}
+void AITrader::ProcessOrderAck(Message& message) {
+    auto& ack = *message.order_ack;
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    auto& resting = ack.is_bid ? resting_bids : resting_asks;
+    auto order = resting.find(ack.commodity);
+    if (order == resting.end() || order->second.order_id != 0) {
+        return;
+    }
+    if (ack.refused) {
+        // never booked, so there's nothing to wait for
+        logger.Log(Log::WARN, std::string("Auction house refused our ") + (ack.is_bid ? "bid" : "ask") + " for " + ack.commodity);
+        resting.erase(order);
+    } else {
+        order->second.order_id = ack.order_id;
+    }
 }
 void AITrader::ProcessRegistrationResponse(Message& message) {
     if (message.register_response->accepted) {
@@ -262,54 +509,65 @@ bool AITrader::HasCommodity(const std::string& commodity, int quantity) {
     auto stored = _inventory.Query(commodity);
     return (stored >= quantity);
 }
-int AITrader::TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) {
-    auto comm = _inventory.GetItem(commodity);
-    if (!comm) {
+int AITrader::TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> /*unit_price*/, bool atomic) {
+    int item = _inventory.Find(commodity);
+    if (item < 0) {
         //item unknown, fail
         logger.Log(Log::ERROR, "Tried to take unknown item "+commodity);
         return 0;
     }
+    return TryTakeItem(item, quantity, atomic);
+}
+int AITrader::TryTakeItem(int item, int quantity, bool atomic) {
     int actual_transferred ;
-    auto stored = _inventory.Query(commodity);
+    auto stored = _inventory.Query(item);
     if ( stored>= quantity) {
         actual_transferred = quantity;
     } else {
         if (atomic) {
             actual_transferred = 0;
-            logger.Log(Log::DEBUG, "Failed to take "+commodity+std::string(" x") + std::to_string(quantity));
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to take "+_inventory.Name(item)+std::string(" x") + std::to_string(quantity));
+            }
         } else {
             actual_transferred = stored;
         }
     }
-    _inventory.TakeItem(commodity, actual_transferred, unit_price);
+    _inventory.TakeItem(item, actual_transferred);
     return actual_transferred;
 }
 int AITrader::TryAddCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) {
-    auto comm = _inventory.GetItem(commodity);
-    if (!comm) {
+    int item = _inventory.Find(commodity);
+    if (item < 0) {
         //item unknown, fail
         logger.Log(Log::ERROR, "Tried to add unknown item "+commodity);
         return 0;
     }
+    return TryAddItem(item, quantity, unit_price, atomic);
+}
+int AITrader::TryAddItem(int item, int quantity, std::optional<double> unit_price, bool atomic) {
+    double size = _inventory.GetSize(item);
     int actual_transferred;
-    if (_inventory.GetEmptySpace() >= quantity*comm->size) {
+    if (_inventory.GetEmptySpace() >= quantity*size) {
         actual_transferred = quantity;
     } else {
         if (atomic) {
             actual_transferred = 0;
-            logger.Log(Log::DEBUG, "Failed to add "+commodity+std::string(" x") + std::to_string(quantity));
+            if (logger.Enabled(Log::DEBUG)) {
+                logger.Log(Log::DEBUG, "Failed to add "+_inventory.Name(item)+std::string(" x") + std::to_string(quantity));
+            }
         } else {
-            actual_transferred = std::floor(_inventory.GetEmptySpace()/comm->size);
+            actual_transferred = std::floor(_inventory.GetEmptySpace()/size);
             //overproduced! Drop value of goods accordingly
             int overproduction = quantity - actual_transferred;
-            _inventory.inventory[commodity].original_cost *= std::pow(1.3, -1*overproduction);
+            _inventory.ScaleCost(item, std::pow(1.3, -1*overproduction));
         }
     }
-    _inventory.AddItem(commodity, actual_transferred, unit_price);
+    _inventory.AddItem(item, actual_transferred, unit_price);
     return actual_transferred;
 }
 int AITrader::GetIdeal(const std::string& name) {
-    auto res = _inventory.GetItem(name);
+    auto* res = _inventory.GetItem(name);
     if (!res) {
         return 0;
     }
@@ -320,67 +578,155 @@ double AITrader::QueryCost(const std::string& name) { return _inventory.QueryCos
 
 // Trading functions
 void AITrader::UpdatePriceModelFromBid(BidResult& result) {
-    for (int i = 0; i < result.quantity_traded; i++) {
-        observed_trading_range[result.commodity].push_back(result.bought_price);
-    }
-
-    while (observed_trading_range[result.commodity].size() > internal_lookback) {
-        observed_trading_range[result.commodity].erase(observed_trading_range[result.commodity].begin());
+    int item = _inventory.Find(result.commodity);
+    if (item < 0) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(price_model_mutex);
+    observed_trading_range[item].Record(result.bought_price, result.quantity_traded);
 }
 void AITrader::UpdatePriceModelFromAsk(const AskResult& result) {
-
-    for (int i = 0; i < result.quantity_traded; i++) {
-        observed_trading_range[result.commodity].push_back(result.avg_price);
-    }
-
-    while (observed_trading_range[result.commodity].size() > internal_lookback) {
-        observed_trading_range[result.commodity].erase(observed_trading_range[result.commodity].begin());
+    int item = _inventory.Find(result.commodity);
+    if (item < 0) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(price_model_mutex);
+    observed_trading_range[item].Record(result.avg_price, result.quantity_traded);
 }
 
-void AITrader::GenerateOffers(const std::string& commodity) {
-    int surplus = _inventory.Surplus(commodity);
+void AITrader::GenerateOffers(int item) {
+    ScopedLatency timer(timings.generate_offers);
+    const std::string& commodity = _inventory.Name(item);
+    std::optional<AskOffer> ask;
+    int surplus = _inventory.Surplus(item);
     if (surplus >= 1) {
 //        logger.Log(Log::DEBUG, "Considering ask for "+commodity + std::string(" - Current surplus = ") + std::to_string(surplus));
-        auto offer = CreateAsk(commodity, 1);
+        auto offer = CreateAsk(item, 1);
         if (offer.quantity > 0) {
-            SendMessage(*Message(id).AddAskOffer(offer), auction_house_id);
+            ask = offer;
         }
     }
+    PlaceAsk(commodity, ask);
+
+    std::optional<BidOffer> bid;
 
-    int shortage = _inventory.Shortage(commodity);
+    int shortage = _inventory.Shortage(item);
     double space = _inventory.GetEmptySpace();
-    double unit_size = _inventory.GetSize(commodity);
+    double unit_size = _inventory.GetSize(item);
 
 
-    double fulfillment;
-    if (class_name == "refiner" || class_name == "blacksmith") {
-        fulfillment = _inventory.Query(commodity) / (0.001 + _inventory.GetItem(commodity)->ideal_quantity);
-        fulfillment = std::max(0.5, fulfillment);
-    } else {
-        fulfillment = _inventory.Query(commodity) / (0.001 + _inventory.GetItem(commodity)->ideal_quantity);
+    double fulfillment = _inventory.Query(item) / (0.001 + _inventory.Get(item).ideal_quantity);
+    if (logic) {
+        fulfillment = std::max((*logic)->fulfillment_floor, fulfillment);
     }
 
     if (fulfillment < 1 && space >= unit_size) {
         int max_limit = (shortage*unit_size <= space) ? shortage : (int) space/shortage;
         if (max_limit > 0)
         {
-            int min_limit = (_inventory.Query(commodity) == 0) ? 1 : 0;
+            int min_limit = (_inventory.Query(item) == 0) ? 1 : 0;
 //            logger.Log(Log::DEBUG, "Considering bid for "+commodity + std::string(" - Current shortage = ") + std::to_string(shortage));
 
             double desperation = 1;
             double days_savings = money / IDLE_TAX;
             desperation *= ( 5 /(days_savings*days_savings)) + 1;
             desperation *= 1 - (0.4*(fulfillment - 0.5))/(1 + 0.4*std::abs(fulfillment-0.5));
-            auto offer = CreateBid(commodity, min_limit, max_limit, desperation);
+            auto offer = CreateBid(item, min_limit, max_limit, desperation);
             if (offer.quantity > 0) {
-                SendMessage(*Message(id).AddBidOffer(offer), auction_house_id);
+                bid = offer;
             }
         }
     }
+    PlaceBid(commodity, bid);
+}
+
+// Keeps our resting order in line with the offer we'd make now: posts it if we have none, amends it if it has moved
+// far enough, and cancels it if we no longer want to trade. Does nothing while the order is awaiting its ack or close.
+void AITrader::PlaceBid(const std::string& commodity, std::optional<BidOffer> offer) {
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    auto resting = resting_bids.find(commodity);
+    if (resting == resting_bids.end()) {
+        if (offer) {
+            resting_bids[commodity] = {0, offer->quantity, offer->unit_price.ToDouble()};
+            offer->timestamps.sent_ns = monotonic_ns();
+            SendMessage(*Message(id).AddBidOffer(std::move(*offer)), auction_house_id);
+        }
+        return;
+    }
+    auto& order = resting->second;
+    if (order.order_id == 0 || order.cancelling) {
+        return;
+    }
+    if (!offer) {
+        order.cancelling = true;
+        SendMessage(*Message(id).AddCancelOrder(CancelOrder(id, order.order_id, commodity, true)), auction_house_id);
+    } else if (WorthAmending(order, offer->quantity, offer->unit_price.ToDouble())) {
+        order.quantity = offer->quantity;
+        order.unit_price = offer->unit_price.ToDouble();
+        SendAmend(AmendOrder(id, order.order_id, commodity, true, order.quantity, order.unit_price));
+    }
+}
+void AITrader::PlaceAsk(const std::string& commodity, std::optional<AskOffer> offer) {
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    auto resting = resting_asks.find(commodity);
+    if (resting == resting_asks.end()) {
+        if (offer) {
+            resting_asks[commodity] = {0, offer->quantity, offer->unit_price.ToDouble()};
+            offer->timestamps.sent_ns = monotonic_ns();
+            SendMessage(*Message(id).AddAskOffer(std::move(*offer)), auction_house_id);
+        }
+        return;
+    }
+    auto& order = resting->second;
+    if (order.order_id == 0 || order.cancelling) {
+        return;
+    }
+    if (!offer) {
+        order.cancelling = true;
+        SendMessage(*Message(id).AddCancelOrder(CancelOrder(id, order.order_id, commodity, false)), auction_house_id);
+    } else if (WorthAmending(order, offer->quantity, offer->unit_price.ToDouble())) {
+        order.quantity = offer->quantity;
+        order.unit_price = offer->unit_price.ToDouble();
+        SendAmend(AmendOrder(id, order.order_id, commodity, false, order.quantity, order.unit_price));
+    }
+}
+// An amend supersedes any earlier one for the same order, so if one is still waiting in our outbox (the AH is backed
+// up) it's overwritten in place rather than queued behind
+void AITrader::SendAmend(AmendOrder amend) {
+    std::uint64_t order_id = amend.order_id;
+    std::pair<int, Message> outgoing = {auction_house_id, *Message(id).AddAmendOrder(std::move(amend))};
+    bool coalesced = outbox.coalesce(outgoing, [order_id] (const std::pair<int, Message>& queued) {
+        return queued.second.amend_order && queued.second.amend_order->order_id == order_id;
+    });
+    if (coalesced) {
+        timings.amends_coalesced.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        outbox.push(std::move(outgoing));
+    }
 }
-BidOffer AITrader::CreateBid(const std::string& commodity, int min_limit, int max_limit, double desperation) {
+// Whether to sit this tick's quoting out. Traders drop out gradually as the AH's load climbs, so the order flow eases
+// off smoothly instead of the whole market going quiet at once.
+bool AITrader::HoldBackOffers() {
+    if (backlogged) {
+        return true;
+    }
+    auto res = auction_house.lock();
+    if (!res) {
+        return false;   // CreateBid/CreateAsk deal with a vanished AH
+    }
+    double load = res->Load();
+    return load > BACKOFF_LOAD && rng_gen.Chance((load - BACKOFF_LOAD)/(1 - BACKOFF_LOAD));
+}
+bool AITrader::WorthAmending(const RestingOrder& order, int quantity, double unit_price) const {
+    // A cut can't wait (we'd be offering what we no longer want to trade), but the odd extra unit of surplus or
+    // shortage can ride along until it adds up
+    if (quantity < order.quantity || quantity > order.quantity*(1 + QUANTITY_AMEND_THRESHOLD)) {
+        return true;
+    }
+    return std::abs(unit_price - order.unit_price) > AMEND_THRESHOLD*order.unit_price;
+}
+BidOffer AITrader::CreateBid(int item, int min_limit, int max_limit, double desperation) {
+    const std::string& commodity = _inventory.Name(item);
     double fair_bid_price;
     auto res = auction_house.lock();
     if (res) {
@@ -397,14 +743,14 @@ BidOffer AITrader::CreateBid(const std::string& commodity, int min_limit, int ma
     double bid_price = fair_bid_price *desperation;
     bid_price = std::max(std::min(max_price, bid_price), min_price);
 
-    int ideal = DetermineBuyQuantity(commodity, bid_price);
+    int ideal = DetermineBuyQuantity(item, bid_price);
     int quantity = std::max(std::min(ideal, max_limit), min_limit);
 
-    //set to expire just before next tick
-    std::uint64_t expiry_ms = to_unix_timestamp_ms(std::chrono::system_clock::now()) + TICK_TIME_MS;
-    return BidOffer(id, commodity, quantity, bid_price, expiry_ms);
+    //rests until filled or cancelled, and is amended from then on (see PlaceBid)
+    return BidOffer(id, commodity, quantity, bid_price, GOOD_TILL_CANCELLED);
 }
-AskOffer AITrader::CreateAsk(const std::string& commodity, int min_limit) {
+AskOffer AITrader::CreateAsk(int item, int min_limit) {
+    const std::string& commodity = _inventory.Name(item);
     //AI agents offer a fair ask price - costs + 15% profit
     double market_price;
     double ask_price;
@@ -417,22 +763,30 @@ AskOffer AITrader::CreateAsk(const std::string& commodity, int min_limit) {
         // (Yes this is hacky)
         return AskOffer(id, commodity, 0, -1, 0);
     }
-    double fair_price = QueryCost(commodity) * 1.15;
-
-    std::uniform_real_distribution<> random_price(fair_price, market_price);
-    ask_price = random_price(rng_gen);
-    ask_price = std::max(MIN_PRICE, ask_price);
-    int quantity = DetermineSaleQuantity(commodity);
+    double fair_price = _inventory.QueryCost(item) * 1.15;
+
+    auto& quote = ask_quotes[item];
+    auto moved = [this] (double price, double quoted) {
+        return std::abs(price - quoted) > AMEND_THRESHOLD*quoted;
+    };
+    if (quote && !moved(fair_price, quote->fair_price) && !moved(market_price, quote->market_price)) {
+        ask_price = quote->price;
+    } else {
+        std::uniform_real_distribution<> random_price(fair_price, market_price);
+        ask_price = random_price(rng_gen);
+        ask_price = std::max(MIN_PRICE, ask_price);
+        quote = AskQuote{fair_price, market_price, ask_price};
+    }
+    int quantity = DetermineSaleQuantity(item);
     //can't sell less than limit
     quantity = quantity < min_limit ? min_limit : quantity;
 
-    //set to expire just before next tick
-    std::uint64_t expiry_ms = to_unix_timestamp_ms(std::chrono::system_clock::now()) + TICK_TIME_MS;
-    return AskOffer(id, commodity, quantity, ask_price, expiry_ms);
+    //rests until filled or cancelled, and is amended from then on (see PlaceAsk)
+    return AskOffer(id, commodity, quantity, ask_price, GOOD_TILL_CANCELLED);
 }
 
-int AITrader::DetermineBuyQuantity(const std::string& commodity, double avg_price) {
-    std::pair<double, double> range = ObserveTradingRange(commodity, internal_lookback);
+int AITrader::DetermineBuyQuantity(int item, double avg_price) {
+    std::pair<double, double> range = ObserveTradingRange(item);
     if (range.first == 0 && range.second == 0) {
         //uninitialised range
         logger.Log(Log::WARN, "Tried to make bid with unitialised trading range");
@@ -440,27 +794,17 @@ int AITrader::DetermineBuyQuantity(const std::string& commodity, double avg_pric
     }
     double favorability = PositionInRange(avg_price, range.first, range.second);
     favorability = 1 - favorability; //do 1 - favorability to see how close we are to the low end
-    double amount_to_buy = favorability * _inventory.Shortage(commodity);//double
+    double amount_to_buy = favorability * _inventory.Shortage(item);//double
 
     return std::ceil(amount_to_buy);
 }
-int AITrader::DetermineSaleQuantity(const std::string& commodity) {
-    return _inventory.Surplus(commodity); //Sell all surplus
+int AITrader::DetermineSaleQuantity(int item) {
+    return _inventory.Surplus(item); //Sell all surplus
 }
 
-std::pair<double, double> AITrader::ObserveTradingRange(const std::string& commodity, int window) {
-    if (observed_trading_range.count(commodity) < 1 || observed_trading_range[commodity].empty()) {
-        return {0,0};
-    }
-    double min_observed = observed_trading_range[commodity][0];
-    double max_observed = observed_trading_range[commodity][0];
-    window = std::min(window, (int) observed_trading_range[commodity].size());
-
-    for (int i = 0; i < window; i++) {
-        min_observed = std::min(min_observed, observed_trading_range[commodity][i]);
-        max_observed = std::max(max_observed, observed_trading_range[commodity][i]);
-    }
-    return {min_observed, max_observed};
+std::pair<double, double> AITrader::ObserveTradingRange(int item) {
+    std::lock_guard<std::mutex> lock(price_model_mutex);
+    return observed_trading_range[item].Range();
 }
 
 // Misc
@@ -489,23 +833,14 @@ void AITrader::Tick() {
     //Stagger starts
     std::this_thread::sleep_for(std::chrono::milliseconds{std::uniform_int_distribution<>(0, TICK_TIME_MS)(rng_gen)});
     logger.Log(Log::INFO, "Beginning tickloop");
+    TraceRecorder::Global().NameThread(unique_name + " tick");
     while (!destroyed) {
         auto t1 = std::chrono::high_resolution_clock::now();
-        if (ready) {
-            if (logic) {
-                logger.Log(Log::DEBUG, "Ticking internal logic");
-                (*logic)->TickRole(*this);
-            }
-            for (const auto &commodity : _inventory.inventory) {
-                GenerateOffers(commodity.first);
-            }
-        }
+        TickOnce();
         if (money <= 0) {
+            // out of money: TickOnce has stopped us, the AH still needs telling
             Shutdown();
         }
-        if (ready) {
-            ticks++;
-        }
         std::chrono::duration<double, std::milli> elapsed_ms = std::chrono::high_resolution_clock::now() - t1;
         int elapsed = elapsed_ms.count();
         if (elapsed < TICK_TIME_MS) {
@@ -520,13 +855,20 @@ void AITrader::TickOnce() {
     if (destroyed) {
         return;
     }
+    ScopedLatency tick_timer(timings.tick);
+    TraceSpan span("Trader tick");
     if (ready) {
         if (logic) {
             logger.Log(Log::DEBUG, "Ticking internal logic");
+            ScopedLatency role_timer(timings.tick_role);
             (*logic)->TickRole(*this);
         }
-        for (const auto& commodity : _inventory.inventory) {
-            GenerateOffers(commodity.first);
+        if (HoldBackOffers()) {
+            timings.offers_held_back.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            for (int item = 0; item < _inventory.NumCommodities(); item++) {
+                GenerateOffers(item);
+            }
         }
     }
     if (money <= 0) {
@@ -539,41 +881,159 @@ void AITrader::TickOnce() {
 }
 
 void AITrader::MessageLoop() {
+    TraceRecorder::Global().NameThread(unique_name + " messages");
     while (true) {
         if (!queue_active) {
             return;
         }
-        FlushInbox();
-        FlushOutbox();
+        {
+            std::lock_guard<std::mutex> lock(message_mutex);
+            if (!parked) {
+                FlushInbox();
+                FlushOutbox();
+            }
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds{1});
     }
 }
 
-bool Role::Random(double chance) {
-    if (chance >= 1) return true;
-    return (rng_gen() < chance*rng_gen.max());
+TraderCheckpoint AITrader::Checkpoint() {
+    TraderCheckpoint checkpoint;
+    checkpoint.id = id;
+    checkpoint.ticks = ticks;
+    checkpoint.class_name = class_name;
+    checkpoint.money = money;
+    if (logic) {
+        checkpoint.min_cost = (*logic)->min_cost;
+        checkpoint.track_costs = (*logic)->track_costs;
+    }
+    checkpoint.inv_capacity = _inventory.max_size;
+    {
+        std::lock_guard<std::mutex> lock(price_model_mutex);
+        for (int item = 0; item < _inventory.NumCommodities(); item++) {
+            auto& entry = _inventory.Get(item);
+            InventoryItem saved(_inventory.Name(item), entry.stored, entry.ideal_quantity);
+            saved.original_cost = entry.original_cost;
+            saved.size = entry.size;
+            checkpoint.inventory.push_back(saved);
+            checkpoint.trading_ranges.push_back(observed_trading_range[item].Entries());
+        }
+    }
+    checkpoint.rng = rng_gen;
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    checkpoint.resting_bids.assign(resting_bids.begin(), resting_bids.end());
+    checkpoint.resting_asks.assign(resting_asks.begin(), resting_asks.end());
+    return checkpoint;
+}
+
+void AITrader::Restore(const TraderCheckpoint& checkpoint) {
+    ticks = checkpoint.ticks;
+    money = checkpoint.money;
+    if (logic) {
+        (*logic)->min_cost = checkpoint.min_cost;
+        (*logic)->track_costs = checkpoint.track_costs;
+    }
+    {
+        std::lock_guard<std::mutex> lock(price_model_mutex);
+        _inventory = Inventory(checkpoint.inv_capacity, checkpoint.inventory);
+        observed_trading_range.assign(_inventory.NumCommodities(), TradingRange(internal_lookback));
+        ask_quotes.assign(_inventory.NumCommodities(), std::nullopt);
+        for (int item = 0; item < _inventory.NumCommodities() && item < (int) checkpoint.trading_ranges.size(); item++) {
+            for (auto& [price, quantity] : checkpoint.trading_ranges[item]) {
+                observed_trading_range[item].Record(price, quantity);
+            }
+        }
+    }
+    rng_gen = checkpoint.rng;
+    std::lock_guard<std::mutex> lock(resting_mutex);
+    resting_bids = std::map<std::string, RestingOrder>(checkpoint.resting_bids.begin(), checkpoint.resting_bids.end());
+    resting_asks = std::map<std::string, RestingOrder>(checkpoint.resting_asks.begin(), checkpoint.resting_asks.end());
+}
+
+bool AITrader::Park() {
+    parked = true;
+    // waits out any flush already under way; every later one will see parked
+    std::lock_guard<std::mutex> lock(message_mutex);
+    return queue_active;
+}
+
+void AITrader::Unpark() {
+    parked = false;
+}
+
+void AITrader::Reset(int new_id, std::optional<std::shared_ptr<Role>> AI_logic, const std::string& new_class_name, double starting_money, double inv_capacity, const std::vector<InventoryItem> &starting_inv) {
+    id = new_id;
+    ticks = 0;
+    class_name = new_class_name;
+    unique_name = class_name + std::to_string(id);
+    logger.Rename(unique_name);
+    rng_gen = Rng::Stream(id);
+    logic = std::move(AI_logic);
+    money = starting_money;
+    ready = false;
+    // anything still queued was for (or from) the previous trader
+    while (inbox.pop()) {}
+    while (outbox.pop()) {}
+    backlogged = false;
+    {
+        std::lock_guard<std::mutex> lock(resting_mutex);
+        resting_bids.clear();
+        resting_asks.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(price_model_mutex);
+        InitInventory(inv_capacity, starting_inv);
+    }
+    destroyed = false;
+    logger.Log(Log::DEBUG, "Reset from a recycled trader");
+}
+
+bool Role::Random(AITrader& trader, double chance) {
+    return trader.rng_gen.Chance(chance);
 }
 void Role::Produce(AITrader& trader, const std::string& commodity, int amount, double chance) {
-    if (amount > 0 && Random(chance)) {
-        trader.logger.Log(Log::DEBUG, "Produced " + std::string(commodity) + std::string(" x") + std::to_string(amount));
+    Produce(trader, trader.FindItem(commodity), amount, chance);
+}
+void Role::Consume(AITrader& trader, const std::string& commodity, int amount, double chance) {
+    Consume(trader, trader.FindItem(commodity), amount, chance);
+}
+void Role::Produce(AITrader& trader, int item, int amount, double chance) {
+    if (amount > 0 && Random(trader, chance)) {
+        if (item < 0) {
+            trader.logger.Log(Log::ERROR, "Tried to produce an item we don't stock");
+            return;
+        }
+        if (trader.logger.Enabled(Log::DEBUG)) {
+            trader.logger.Log(Log::DEBUG, "Produced " + trader._inventory.Name(item) + std::string(" x") + std::to_string(amount));
+        }
 
         //the richer you are, the greedier you get (the higher your minimum cost becomes)
         track_costs = std::max(trader.QueryMoney() / 50, track_costs);
         track_costs = std::max(min_cost, track_costs);
-        trader.TryAddCommodity(commodity, amount, track_costs /  amount, false);
+        // the auction house may be settling a trade against this inventory from a resolve worker
+        std::lock_guard<std::mutex> settlement_lock(trader.settlement_mutex);
+        trader.TryAddItem(item, amount, track_costs /  amount, false);
         track_costs = 0;
     }
 }
-void Role::Consume(AITrader& trader, const std::string& commodity, int amount, double chance) {
-    if (Random(chance)) {
-        trader.logger.Log(Log::DEBUG, "Consumed " + std::string(commodity) + std::string(" x") + std::to_string(amount));
-        int actual_quantity = trader.TryTakeCommodity(commodity, amount, 0, false);
+void Role::Consume(AITrader& trader, int item, int amount, double chance) {
+    if (Random(trader, chance)) {
+        if (item < 0) {
+            trader.logger.Log(Log::ERROR, "Tried to consume an item we don't stock");
+            return;
+        }
+        if (trader.logger.Enabled(Log::DEBUG)) {
+            trader.logger.Log(Log::DEBUG, "Consumed " + trader._inventory.Name(item) + std::string(" x") + std::to_string(amount));
+        }
+        std::lock_guard<std::mutex> settlement_lock(trader.settlement_mutex);
+        int actual_quantity = trader.TryTakeItem(item, amount, false);
         if (actual_quantity > 0) {
-            track_costs += actual_quantity*trader.QueryCost(commodity);
+            track_costs += actual_quantity*trader._inventory.QueryCost(item);
         }
     }
 }
 void Role::LoseMoney(AITrader& trader, double amount) {
+    std::lock_guard<std::mutex> settlement_lock(trader.settlement_mutex);
     trader.ForceTakeMoney(amount);
     //track_costs += amount;
 }
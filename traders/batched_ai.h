@@ -0,0 +1,596 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_BATCHED_AI_H
+#define CPPBAZAARBOT_BATCHED_AI_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "inventory.h"
+#include "recipes.h"
+#include "../common/economy.h"
+#include "../common/messages.h"
+#include "../common/rng.h"
+#include "../auction/auction_house.h"
+
+// Market prices every trader in a batch decides against, taken once per tick rather than looked up per trader.
+// Indexed like the population's commodity columns.
+struct MarketSnapshot {
+    std::vector<double> avg_price;
+    std::vector<double> avg_buy_price;
+
+    static MarketSnapshot FromAuctionHouse(const AuctionHouse& auction_house, const std::vector<std::string>& commodities, int lookback_ms) {
+        MarketSnapshot snapshot;
+        for (auto& commodity : commodities) {
+            snapshot.avg_price.push_back(auction_house.t_AverageHistoricalPrice(commodity, lookback_ms));
+            snapshot.avg_buy_price.push_back(auction_house.t_AverageHistoricalBuyPrice(commodity, lookback_ms));
+        }
+        return snapshot;
+    }
+    static MarketSnapshot Uniform(std::size_t num_commodities, double price) {
+        MarketSnapshot snapshot;
+        snapshot.avg_price.assign(num_commodities, price);
+        snapshot.avg_buy_price.assign(num_commodities, price);
+        return snapshot;
+    }
+};
+
+struct BatchedOffer {
+    int row;            // trader within the population
+    int commodity;      // column index
+    int quantity;
+    double unit_price;
+};
+
+class BatchedPopulation;
+
+// Lets the auction house settle against one row of a population as if it were an ordinary Trader.
+// Holds no state of its own; results it receives are picked up by BatchedPopulation::DrainResults().
+class BatchedTrader : public Trader {
+private:
+    friend BatchedPopulation;
+    BatchedPopulation* population;
+    int row;
+public:
+    BatchedTrader(int id, const std::string& class_name, BatchedPopulation* population, int row)
+        : Trader(id, class_name)
+        , population(population)
+        , row(row) {};
+
+    bool HasMoney(double quantity) override;
+    bool HasCommodity(const std::string& commodity, int quantity) override;
+protected:
+    double TryTakeMoney(double quantity, bool atomic) override;
+    void ForceTakeMoney(double quantity) override;
+    void AddMoney(double quantity) override;
+    int TryAddCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) override;
+    int TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) override;
+};
+
+// Data-oriented alternative to a crowd of AITraders: every trader of one role lives in a row of contiguous columns
+// (money, and stock/ideal/cost/observed price range per commodity), and each decision phase is a loop over the whole
+// population rather than a virtual call per trader. Decisions follow the same rules as an AITrader running the same
+// recipe, except that the observed trading range is a decaying min/max band rather than a window of recent trades.
+//
+// Not thread safe: tick it from the thread that drives the auction house (between AH ticks), since the AH settles
+// trades directly against the columns.
+class BatchedPopulation {
+public:
+    const std::string role;
+    double MIN_PRICE = 0.10;
+    double IDLE_TAX = 20;
+    double RANGE_DECAY = 0.02; //how far the observed range relaxes towards each traded unit's price
+
+private:
+    friend BatchedTrader;
+    std::shared_ptr<const RecipeProgram> program;
+    std::vector<int> slot_column;           // program slot -> commodity column, -1 if we don't stock it
+    double fulfillment_floor;               // see Role::fulfillment_floor
+    std::vector<std::string> commodities;   // column order for all per-commodity columns
+    std::vector<double> unit_size;
+    double inv_capacity;
+    Rng rng;
+
+    // per trader
+    std::vector<int> ids;                   // auction house id, 0 until registered
+    std::vector<double> money;
+    std::vector<double> min_cost;           // minimum fair price for a produced good
+    std::vector<double> track_costs;        // cost of inputs consumed since the last production
+    std::vector<std::uint8_t> alive;
+    std::vector<int> age;
+
+    // per commodity, then per trader
+    std::vector<std::vector<int>> stock;
+    std::vector<std::vector<int>> ideal;
+    std::vector<std::vector<double>> cost;
+    std::vector<std::vector<double>> range_low;
+    std::vector<std::vector<double>> range_high;
+
+    // scratch, sized to the population
+    std::vector<double> used_space;
+    std::vector<double> desperation;
+
+    std::vector<std::shared_ptr<BatchedTrader>> handles;   // null while the row is unregistered or free
+    std::vector<int> unregistered;          // rows added since the last Register
+    std::vector<int> retiring;              // rows deregistered, whose handle the auction house may still hold
+    std::vector<int> free_rows;             // rows Add can reuse
+
+    // recipe evaluation, per program slot / rule, then per trader
+    std::vector<std::vector<std::uint8_t>> held;
+    std::vector<std::uint8_t> running;
+    std::vector<std::uint8_t> fires;
+
+    double Uniform() {
+        return rng.Uniform();
+    }
+    bool Random(double chance) {
+        return rng.Chance(chance);
+    }
+
+    double UsedSpace(int row) const {
+        double used = 0;
+        for (std::size_t c = 0; c < commodities.size(); c++) {
+            used += stock[c][row]*unit_size[c];
+        }
+        return used;
+    }
+    int Query(int col, int row) const {
+        return (col < 0) ? 0 : stock[col][row];
+    }
+
+    // Same semantics as Role::Consume and a non-atomic AITrader::TryTakeCommodity
+    void Consume(int col, int row, int amount, double chance = 1) {
+        if (col < 0 || !Random(chance)) {
+            return;
+        }
+        int actual = std::min(stock[col][row], amount);
+        stock[col][row] -= actual;
+        if (actual > 0) {
+            track_costs[row] += actual*cost[col][row];
+        }
+    }
+    // Same semantics as Role::Produce and a non-atomic AITrader::TryAddCommodity
+    void Produce(int col, int row, int amount, double chance = 1) {
+        if (col < 0 || amount <= 0 || !Random(chance)) {
+            return;
+        }
+        track_costs[row] = std::max(money[row] / 50, track_costs[row]);
+        track_costs[row] = std::max(min_cost[row], track_costs[row]);
+        double unit_price = track_costs[row] / amount;
+        track_costs[row] = 0;
+
+        double empty_space = inv_capacity - UsedSpace(row);
+        int actual = amount;
+        if (empty_space < amount*unit_size[col]) {
+            actual = (int) std::floor(empty_space/unit_size[col]);
+            //overproduced! Drop value of goods accordingly
+            cost[col][row] *= std::pow(1.3, -1*(amount - actual));
+        }
+        int& stored = stock[col][row];
+        cost[col][row] = (stored > 0) ? (cost[col][row]*stored + actual*unit_price) / (stored + actual) : unit_price;
+        stored += actual;
+    }
+
+    void RunInstruction(const RecipeProgram::Instruction& instruction, int num_rows) {
+        int col = (instruction.slot < 0) ? -1 : slot_column[instruction.slot];
+        switch (instruction.op) {
+            case RecipeStep::IDLE_TAX:
+                for (int row = 0; row < num_rows; row++) {
+                    if (fires[row] && Random(instruction.chance)) {
+                        money[row] -= IDLE_TAX;
+                    }
+                }
+                return;
+            case RecipeStep::CONSUME:
+                for (int row = 0; row < num_rows; row++) {
+                    if (fires[row]) {
+                        Consume(col, row, instruction.amount, instruction.chance);
+                    }
+                }
+                return;
+            case RecipeStep::PRODUCE:
+                for (int row = 0; row < num_rows; row++) {
+                    if (fires[row]) {
+                        Produce(col, row, instruction.amount, instruction.chance);
+                    }
+                }
+                return;
+            case RecipeStep::CONVERT: {
+                int output_col = slot_column[instruction.output_slot];
+                for (int row = 0; row < num_rows; row++) {
+                    if (fires[row] && Random(instruction.chance)) {
+                        int quantity = Query(col, row);
+                        if (instruction.amount > 0) {
+                            quantity = std::min(quantity, instruction.amount);
+                        }
+                        Consume(col, row, quantity);
+                        Produce(output_col, row, quantity);
+                    }
+                }
+                return;
+            }
+        }
+    }
+
+    // Grows every per-trader column by one row
+    int AppendRow() {
+        int row = (int) money.size();
+        ids.push_back(0);
+        money.push_back(0);
+        min_cost.push_back(0);
+        track_costs.push_back(0);
+        alive.push_back(0);
+        age.push_back(0);
+        for (std::size_t c = 0; c < commodities.size(); c++) {
+            stock[c].push_back(0);
+            ideal[c].push_back(0);
+            cost[c].push_back(0);
+            range_low[c].push_back(0);
+            range_high[c].push_back(0);
+        }
+        used_space.push_back(0);
+        desperation.push_back(0);
+        handles.emplace_back();
+        for (auto& column : held) {
+            column.push_back(0);
+        }
+        running.push_back(0);
+        fires.push_back(0);
+        return row;
+    }
+
+    // A retired row is free once the auction house has applied its shutdown and let go of the handle, so that nothing
+    // can settle against it after it's reused
+    void ReleaseRetiredRows() {
+        auto released = std::remove_if(retiring.begin(), retiring.end(), [this](int row) {
+            if (handles[row].use_count() > 1) {
+                return false;
+            }
+            handles[row].reset();
+            free_rows.push_back(row);
+            return true;
+        });
+        retiring.erase(released, retiring.end());
+    }
+
+    int Column(const std::string& commodity) const {
+        for (std::size_t c = 0; c < commodities.size(); c++) {
+            if (commodities[c] == commodity) {
+                return (int) c;
+            }
+        }
+        return -1;
+    }
+
+public:
+    // Traders of the given role, each holding commodities in the order of the role's starting inventory
+    BatchedPopulation(const RoleDefinition& definition, double inv_capacity, std::uint64_t stream)
+        : role(definition.name)
+        , program(definition.program)
+        , fulfillment_floor(definition.fulfillment_floor)
+        , inv_capacity(inv_capacity)
+        , rng(Rng::Stream(Rng::POPULATION_STREAMS + stream)) {
+        for (auto& item : definition.inventory) {
+            commodities.push_back(item.name);
+            unit_size.push_back(item.size);
+        }
+        stock.resize(commodities.size());
+        ideal.resize(commodities.size());
+        cost.resize(commodities.size());
+        range_low.resize(commodities.size());
+        range_high.resize(commodities.size());
+        for (auto& commodity : program->commodities) {
+            slot_column.push_back(Column(commodity));
+        }
+        held.resize(program->commodities.size());
+    }
+
+    BatchedPopulation(const BatchedPopulation&) = delete;
+    BatchedPopulation& operator=(const BatchedPopulation&) = delete;
+
+    const std::vector<std::string>& Commodities() const { return commodities; }
+    std::size_t size() const { return money.size(); }
+    int NumAlive() const {
+        int num = 0;
+        for (auto flag : alive) {
+            num += flag;
+        }
+        return num;
+    }
+    double Money(int row) const { return money[row]; }
+    int Stock(int row, int col) const { return stock[col][row]; }
+
+    // Adds a trader holding starting_inv (in column order), priced like a newly created AITrader. Returns its row,
+    // which may be that of a trader who has died and been deregistered.
+    int Add(double starting_money, double trader_min_cost, const std::vector<InventoryItem>& starting_inv, const MarketSnapshot& market) {
+        int row;
+        if (free_rows.empty()) {
+            row = AppendRow();
+        } else {
+            row = free_rows.back();
+            free_rows.pop_back();
+        }
+        ids[row] = 0;
+        money[row] = starting_money;
+        min_cost[row] = trader_min_cost;
+        track_costs[row] = 0;
+        alive[row] = 1;
+        age[row] = 0;
+        for (std::size_t c = 0; c < commodities.size(); c++) {
+            double base_price = market.avg_price[c];
+            stock[c][row] = starting_inv[c].stored;
+            ideal[c][row] = starting_inv[c].ideal_quantity;
+            cost[c][row] = base_price;
+            range_low[c][row] = base_price*0.5;
+            range_high[c][row] = base_price*2;
+        }
+        unregistered.push_back(row);
+        return row;
+    }
+
+    // Production and consumption for every living trader, then retire anyone who has run out of money.
+    // Runs the recipe a rule at a time across the whole population rather than a trader at a time.
+    void TickRoles() {
+        const int num_rows = (int) size();
+        for (std::size_t slot = 0; slot < held.size(); slot++) {
+            for (int row = 0; row < num_rows; row++) {
+                held[slot][row] = Query(slot_column[slot], row) > 0;
+            }
+        }
+        for (int row = 0; row < num_rows; row++) {
+            running[row] = alive[row];
+        }
+        for (auto& rule : program->rules) {
+            for (int row = 0; row < num_rows; row++) {
+                fires[row] = running[row];
+            }
+            for (int t = rule.first_test; t < rule.first_test + rule.num_tests; t++) {
+                auto& test = program->tests[t];
+                const std::uint8_t* held_slot = held[test.slot].data();
+                for (int row = 0; row < num_rows; row++) {
+                    fires[row] &= (held_slot[row] == test.held);
+                }
+            }
+            for (int i = rule.first_instruction; i < rule.first_instruction + rule.num_instructions; i++) {
+                RunInstruction(program->instructions[i], num_rows);
+            }
+            if (rule.last) {
+                for (int row = 0; row < num_rows; row++) {
+                    running[row] &= !fires[row];
+                }
+            }
+        }
+        for (std::size_t row = 0; row < size(); row++) {
+            alive[row] &= (money[row] > 0);
+            age[row] += alive[row];
+        }
+    }
+
+    // The bids and asks each living trader would post this tick, same rules as AITrader::GenerateOffers.
+    // Appends to bids and asks.
+    void GenerateOffers(const MarketSnapshot& market, std::vector<BatchedOffer>& bids, std::vector<BatchedOffer>& asks) {
+        const int num_rows = (int) size();
+        const int num_cols = (int) commodities.size();
+        for (int row = 0; row < num_rows; row++) {
+            used_space[row] = 0;
+        }
+        for (int c = 0; c < num_cols; c++) {
+            const int* stored = stock[c].data();
+            const double size_c = unit_size[c];
+            for (int row = 0; row < num_rows; row++) {
+                used_space[row] += stored[row]*size_c;
+            }
+        }
+
+        for (int c = 0; c < num_cols; c++) {
+            const int* stored = stock[c].data();
+            const int* target = ideal[c].data();
+            const double size_c = unit_size[c];
+
+            // asks: sell all surplus at a random price between cost+15% and the market's buy price
+            double market_price = market.avg_buy_price[c];
+            for (int row = 0; row < num_rows; row++) {
+                int surplus = stored[row] - target[row];
+                if (!alive[row] || stored[row] == 0 || surplus < 1) {
+                    continue;
+                }
+                double fair_price = cost[c][row]*1.15;
+                double ask_price = fair_price + Uniform()*(market_price - fair_price);
+                asks.push_back({row, c, surplus, std::max(MIN_PRICE, ask_price)});
+            }
+
+            // bids: desperation grows as savings and stock run low
+            for (int row = 0; row < num_rows; row++) {
+                double fulfillment = std::max(fulfillment_floor, stored[row] / (0.001 + target[row]));
+                double days_savings = money[row] / IDLE_TAX;
+                double d = (5 / (days_savings*days_savings)) + 1;
+                d *= 1 - (0.4*(fulfillment - 0.5))/(1 + 0.4*std::abs(fulfillment - 0.5));
+                desperation[row] = (fulfillment < 1) ? d : 0;
+            }
+            for (int row = 0; row < num_rows; row++) {
+                double space = inv_capacity - used_space[row];
+                if (!alive[row] || desperation[row] == 0 || space < size_c) {
+                    continue;
+                }
+                int shortage = std::max(0, target[row] - stored[row]);
+                if (shortage == 0) {
+                    continue;
+                }
+                int max_limit = (shortage*size_c <= space) ? shortage : (int) space/shortage;
+                if (max_limit <= 0) {
+                    continue;
+                }
+                int min_limit = (stored[row] == 0) ? 1 : 0;
+                double bid_price = std::max(std::min(money[row], market.avg_price[c]*desperation[row]), MIN_PRICE);
+
+                // buy more the closer the price is to the bottom of the range we've seen trade
+                double low = range_low[c][row];
+                double high = range_high[c][row];
+                double position = (high > low) ? std::clamp((bid_price - low)/(high - low), 0.0, 1.0) : 1.0;
+                int wanted = (int) std::ceil((1 - position)*shortage);
+                int quantity = std::max(std::min(wanted, max_limit), min_limit);
+                if (quantity > 0) {
+                    bids.push_back({row, c, quantity, bid_price});
+                }
+            }
+        }
+    }
+
+    // Updates a trader's observed trading range with units that traded at unit_price
+    void RecordTrade(int row, int col, int quantity, double unit_price) {
+        if (quantity <= 0) {
+            return;
+        }
+        double weight = std::min(1.0, quantity*RANGE_DECAY);
+        double& low = range_low[col][row];
+        double& high = range_high[col][row];
+        low = (unit_price < low) ? unit_price : low + weight*(unit_price - low);
+        high = (unit_price > high) ? unit_price : high - weight*(high - unit_price);
+    }
+
+    // AUCTION HOUSE INTEGRATION
+    // Registers a handle for every trader not yet registered, taking ids from next_id upwards. The population must
+    // outlive its registrations (see Deregister).
+    void Register(AuctionHouse& auction_house, int& next_id) {
+        std::vector<std::shared_ptr<BatchedTrader>> new_handles;
+        new_handles.reserve(unregistered.size());
+        for (int row : unregistered) {
+            if (!alive[row]) {
+                // died before it was ever registered
+                free_rows.push_back(row);
+                continue;
+            }
+            ids[row] = next_id++;
+            handles[row] = std::make_shared<BatchedTrader>(ids[row], role, this, row);
+            new_handles.push_back(handles[row]);
+        }
+        unregistered.clear();
+        // our ids are unique, and handles have no use for a response
+        auction_house.RegisterTraders(new_handles, false);
+    }
+
+    // Sends offers to the auction house as immediate orders, and deregisters traders that have died since. Their rows
+    // are freed for Add once the auction house has processed the deregistration.
+    // Offers from traders added since the last Register are dropped, since they have no id to trade under: call
+    // Register before generating the offers to submit.
+    void Submit(AuctionHouse& auction_house, const std::vector<BatchedOffer>& bids, const std::vector<BatchedOffer>& asks) {
+        auto now_ns = monotonic_ns();
+        for (auto& bid : bids) {
+            if (ids[bid.row] == 0) {
+                continue;
+            }
+            auto msg = Message(ids[bid.row]);
+            msg.AddBidOffer(BidOffer(ids[bid.row], commodities[bid.commodity], bid.quantity, bid.unit_price));
+            msg.bid_offer->timestamps.sent_ns = now_ns;
+            msg.StampArrival(now_ns);
+            auction_house.ReceiveMessage(std::move(msg));
+        }
+        for (auto& ask : asks) {
+            if (ids[ask.row] == 0) {
+                continue;
+            }
+            auto msg = Message(ids[ask.row]);
+            msg.AddAskOffer(AskOffer(ids[ask.row], commodities[ask.commodity], ask.quantity, ask.unit_price));
+            msg.ask_offer->timestamps.sent_ns = now_ns;
+            msg.StampArrival(now_ns);
+            auction_house.ReceiveMessage(std::move(msg));
+        }
+        ReleaseRetiredRows();
+        for (int row = 0; row < (int) size(); row++) {
+            if (!alive[row] && ids[row] != 0) {
+                auction_house.ReceiveMessage(*Message(ids[row]).AddShutdownNotify({ids[row], role, age[row]}));
+                ids[row] = 0;
+                retiring.push_back(row);
+            }
+        }
+    }
+
+    void Deregister(AuctionHouse& auction_house) {
+        for (int row = 0; row < (int) size(); row++) {
+            if (ids[row] != 0) {
+                auction_house.ReceiveMessage(*Message(ids[row]).AddShutdownNotify({ids[row], role, age[row]}));
+                ids[row] = 0;
+                retiring.push_back(row);
+            }
+        }
+    }
+
+    // Feeds every result the auction house has delivered to our handles into the price model. Returns the number of
+    // units traded.
+    int DrainResults() {
+        int units_traded = 0;
+        for (auto& handle : handles) {
+            if (!handle) {
+                continue;
+            }
+            auto incoming_message = handle->inbox.pop();
+            while (incoming_message) {
+                if (incoming_message->GetType() == Msg::BID_RESULT) {
+                    auto& result = *incoming_message->bid_result;
+                    RecordTrade(handle->row, Column(result.commodity), result.quantity_traded, result.bought_price);
+                    units_traded += result.quantity_traded;
+                } else if (incoming_message->GetType() == Msg::ASK_RESULT) {
+                    auto& result = *incoming_message->ask_result;
+                    RecordTrade(handle->row, Column(result.commodity), result.quantity_traded, result.avg_price);
+                    units_traded += result.quantity_traded;
+                }
+                incoming_message = handle->inbox.pop();
+            }
+        }
+        return units_traded;
+    }
+};
+
+bool BatchedTrader::HasMoney(double quantity) {
+    return population->money[row] >= quantity;
+}
+bool BatchedTrader::HasCommodity(const std::string& commodity, int quantity) {
+    int col = population->Column(commodity);
+    return col >= 0 && population->stock[col][row] >= quantity;
+}
+double BatchedTrader::TryTakeMoney(double quantity, bool atomic) {
+    double& money = population->money[row];
+    double amount_transferred = atomic ? ((money < quantity) ? 0 : quantity) : std::min(money, quantity);
+    money -= amount_transferred;
+    return amount_transferred;
+}
+void BatchedTrader::ForceTakeMoney(double quantity) {
+    population->money[row] -= quantity;
+}
+void BatchedTrader::AddMoney(double quantity) {
+    population->money[row] += quantity;
+}
+int BatchedTrader::TryAddCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) {
+    int col = population->Column(commodity);
+    if (col < 0) {
+        return 0;
+    }
+    double empty_space = population->inv_capacity - population->UsedSpace(row);
+    double size = population->unit_size[col];
+    int actual = (empty_space >= quantity*size) ? quantity : (atomic ? 0 : (int) std::floor(empty_space/size));
+    int& stored = population->stock[col][row];
+    double& cost = population->cost[col][row];
+    if (unit_price && *unit_price > 0 && actual > 0) {
+        cost = (stored > 0) ? (cost*stored + actual*(*unit_price)) / (stored + actual) : *unit_price;
+    }
+    stored += actual;
+    return actual;
+}
+int BatchedTrader::TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> /*unit_price*/, bool atomic) {
+    int col = population->Column(commodity);
+    if (col < 0) {
+        return 0;
+    }
+    int& stored = population->stock[col][row];
+    int actual = (stored >= quantity) ? quantity : (atomic ? 0 : stored);
+    stored -= actual;
+    return actual;
+}
+
+#endif//CPPBAZAARBOT_BATCHED_AI_H
@@ -5,12 +5,16 @@
 #ifndef CPPBAZAARBOT_FAKE_TRADER_H
 #define CPPBAZAARBOT_FAKE_TRADER_H
 
+#include <random>
 #include <utility>
 
 #include "../common/messages.h"
 
 #include "../auction/auction_house.h"
 #include "../metrics/logger.h"
+#include "../metrics/latency.h"
+#include "../metrics/order_latency.h"
+#include "../common/rng.h"
 
 
 struct OngoingShortage {
@@ -40,7 +44,35 @@ struct OngoingSurplus {
     int start_tick;
     int duration;
 };
-//This class is used to simulate shortage/surplus events by placing loads of fake bids on command
+namespace LoadGen {
+    enum Distribution {
+        UNIFORM,    // mean +/- spread*mean
+        NORMAL      // standard deviation spread*mean
+    };
+}
+
+// Describes the synthetic order flow a FakeTrader generates in load-generator mode
+struct LoadProfile {
+    double orders_per_second = 1000;
+    std::vector<std::string> commodities;   // each order picks one at random
+    double bid_fraction = 0.5;              // share of orders that are bids
+
+    LoadGen::Distribution price_distribution = LoadGen::NORMAL;
+    double mid_price = 10;
+    double price_spread = 0.1;
+
+    LoadGen::Distribution size_distribution = LoadGen::UNIFORM;
+    double mean_quantity = 5;
+    double quantity_spread = 0.8;
+
+    // Optional bursts: for burst_duration_ms out of every burst_period_ms the rate is multiplied by burst_multiplier
+    int burst_period_ms = 0;
+    int burst_duration_ms = 0;
+    double burst_multiplier = 1;
+};
+
+//This class is used to simulate shortage/surplus events by placing loads of fake bids on command.
+//It can also act as a load generator, sending a steady (or bursty) stream of orders at a target rate.
 class FakeTrader : public Trader {
 private:
     std::weak_ptr<AuctionHouse> auction_house;
@@ -51,7 +83,20 @@ private:
 
     std::vector<OngoingShortage> shortages = {};
     std::vector<OngoingSurplus> surpluses = {};
+
+    std::optional<LoadProfile> load_profile = std::nullopt;
+    Rng rng_gen = Rng::Stream(id);
+    std::int64_t load_start_ns = 0;
+    std::int64_t last_load_ns = 0;
+    double owed_orders = 0;     // fractional orders carried between ticks so the average rate is exact
 public:
+    // Load generator statistics
+    std::uint64_t orders_sent = 0;
+    std::uint64_t orders_refused = 0;      // turned away by a full AH inbox, and dropped
+    std::uint64_t results_received = 0;
+    LatencyHistogram ack_latency{"load ack latency"};
+    OrderLifecycleTracker order_latency;
+
     FakeTrader(int id, std::weak_ptr<AuctionHouse> auction_house_ptr)
         : Trader(id, "fake")
         , auction_house(std::move(auction_house_ptr)) {
@@ -72,8 +117,15 @@ public:
     //places 50 absurdly low asks for a good this tick
     void TriggerSurplus(OngoingSurplus& surplus);
 
+    void EnableLoadGeneration(LoadProfile profile, unsigned int seed);
+    double CurrentLoadRate(std::int64_t now_ns) const;
+
     void Tick();
 private:
+    void GenerateLoad();
+    double Sample(LoadGen::Distribution distribution, double mean, double spread);
+    void ProcessResult(const std::string& commodity, const OrderTimestamps& timestamps);
+
     friend AuctionHouse;
     double TryTakeMoney(double quantity, bool atomic) override;
     void AddMoney(double quantity) override;
@@ -98,18 +150,30 @@ void FakeTrader::Tick() {
     for (auto& shortage : shortages) {
         TriggerShortage(shortage);
     }
+    if (load_profile) {
+        GenerateLoad();
+    }
     FlushOutbox();
     ticks++;
 }
 
+// Like an open-loop client, we don't wait for a backed-up AH: whatever it refuses is dropped and counted
 void FakeTrader::FlushOutbox() {
+    auto res = auction_house.lock();
+    if (!res) {
+        return;
+    }
     auto outgoing = outbox.pop();
     while (outgoing) {
         // Trader can currently only talk to auction houses (not other traders)
-        if (outgoing->first != auction_house_id) {
-            continue;
+        if (outgoing->first == auction_house_id) {
+            outgoing->second.StampArrival(monotonic_ns());
+            if (outgoing->second.GetType() == Msg::REGISTER_REQUEST) {
+                res->ReceiveMessage(std::move(outgoing->second));
+            } else if (!res->TryReceiveMessage(outgoing->second)) {
+                orders_refused++;
+            }
         }
-        auction_house.lock()->ReceiveMessage(std::move(outgoing->second));
         outgoing = outbox.pop();
     }
 }
@@ -117,10 +181,84 @@ void FakeTrader::FlushOutbox() {
 void FakeTrader::FlushInbox() {
     auto incoming_message = inbox.pop();
     while (incoming_message) {
+        // only final results count; interim fill reports for orders still resting are ignored
+        if (incoming_message->GetType() == Msg::BID_RESULT && incoming_message->bid_result->closed) {
+            ProcessResult(incoming_message->bid_result->commodity, incoming_message->bid_result->timestamps);
+        } else if (incoming_message->GetType() == Msg::ASK_RESULT && incoming_message->ask_result->closed) {
+            ProcessResult(incoming_message->ask_result->commodity, incoming_message->ask_result->timestamps);
+        }
         incoming_message = inbox.pop();
     }
 }
 
+void FakeTrader::ProcessResult(const std::string& commodity, const OrderTimestamps& timestamps) {
+    if (timestamps.sent_ns == 0) {
+        return; //not one of ours (eg a shortage bid)
+    }
+    auto now = monotonic_ns();
+    results_received++;
+    ack_latency.Record(now - timestamps.sent_ns);
+    order_latency.Record(commodity, timestamps, now);
+}
+
+void FakeTrader::EnableLoadGeneration(LoadProfile profile, unsigned int seed) {
+    rng_gen = Rng(seed, id);
+    load_profile = std::move(profile);
+    load_start_ns = monotonic_ns();
+    last_load_ns = load_start_ns;
+    owed_orders = 0;
+}
+
+double FakeTrader::CurrentLoadRate(std::int64_t now_ns) const {
+    if (!load_profile) {
+        return 0;
+    }
+    double rate = load_profile->orders_per_second;
+    if (load_profile->burst_period_ms > 0) {
+        auto elapsed_ms = (now_ns - load_start_ns) / 1000000;
+        if (elapsed_ms % load_profile->burst_period_ms < load_profile->burst_duration_ms) {
+            rate *= load_profile->burst_multiplier;
+        }
+    }
+    return rate;
+}
+
+double FakeTrader::Sample(LoadGen::Distribution distribution, double mean, double spread) {
+    if (distribution == LoadGen::NORMAL) {
+        return std::normal_distribution<>(mean, spread*mean)(rng_gen);
+    }
+    return std::uniform_real_distribution<>(mean*(1 - spread), mean*(1 + spread))(rng_gen);
+}
+
+void FakeTrader::GenerateLoad() {
+    auto& profile = *load_profile;
+    if (profile.commodities.empty()) {
+        return;
+    }
+    auto now = monotonic_ns();
+    owed_orders += CurrentLoadRate(now) * (now - last_load_ns) / 1e9;
+    last_load_ns = now;
+
+    std::uniform_int_distribution<> random_commodity(0, (int) profile.commodities.size() - 1);
+    std::uniform_real_distribution<> random_side(0, 1);
+    while (owed_orders >= 1) {
+        owed_orders -= 1;
+        auto& commodity = profile.commodities[random_commodity(rng_gen)];
+        double price = std::max(LOW_PRICE, Sample(profile.price_distribution, profile.mid_price, profile.price_spread));
+        int quantity = std::max(1, (int) std::lround(Sample(profile.size_distribution, profile.mean_quantity, profile.quantity_spread)));
+        if (random_side(rng_gen) < profile.bid_fraction) {
+            auto offer = BidOffer(id, commodity, quantity, price);
+            offer.timestamps.sent_ns = now;
+            SendMessage(*Message(id).AddBidOffer(offer), auction_house_id);
+        } else {
+            auto offer = AskOffer(id, commodity, quantity, price);
+            offer.timestamps.sent_ns = now;
+            SendMessage(*Message(id).AddAskOffer(offer), auction_house_id);
+        }
+        orders_sent++;
+    }
+}
+
 void FakeTrader::RegisterShortage(const std::string& commodity, double severity, int start, int duration) {
     shortages.emplace_back(commodity, severity, start, duration);
 }
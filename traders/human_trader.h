@@ -56,7 +56,6 @@ public:
     ~PlayerTrader() {
         logger.Log(Log::DEBUG, "Destroying Player trader");
         Shutdown();
-        _inventory.inventory.clear();
         auction_house.reset();
     }
 private:
@@ -164,6 +163,8 @@ void PlayerTrader::FlushInbox() {
             ProcessBidResult(*incoming_message);
         } else if (incoming_message->GetType() == Msg::ASK_RESULT) {
             ProcessAskResult(*incoming_message);
+        } else if (incoming_message->GetType() == Msg::ORDER_ACK) {
+            //no-op
         } else if (incoming_message->GetType() == Msg::REGISTER_RESPONSE) {
             ProcessRegistrationResponse(*incoming_message);
         } else if (incoming_message->GetType() == Msg::SHUTDOWN_COMMAND) {
@@ -226,15 +227,15 @@ bool PlayerTrader::HasCommodity(const std::string& commodity, int quantity) {
     auto stored = _inventory.Query(commodity);
     return (stored >= quantity);
 }
-int PlayerTrader::TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) {
-    auto comm = _inventory.GetItem(commodity);
-    if (!comm) {
+int PlayerTrader::TryTakeCommodity(const std::string& commodity, int quantity, std::optional<double> /*unit_price*/, bool atomic) {
+    int item = _inventory.Find(commodity);
+    if (item < 0) {
         //item unknown, fail
         logger.Log(Log::ERROR, "Tried to take unknown item "+commodity);
         return 0;
     }
     int actual_transferred ;
-    auto stored = _inventory.Query(commodity);
+    auto stored = _inventory.Query(item);
     if ( stored>= quantity) {
         actual_transferred = quantity;
     } else {
@@ -245,31 +246,32 @@ int PlayerTrader::TryTakeCommodity(const std::string& commodity, int quantity, s
             actual_transferred = stored;
         }
     }
-    _inventory.TakeItem(commodity, actual_transferred, unit_price);
+    _inventory.TakeItem(item, actual_transferred);
     return actual_transferred;
 }
 int PlayerTrader::TryAddCommodity(const std::string& commodity, int quantity, std::optional<double> unit_price, bool atomic) {
-    auto comm = _inventory.GetItem(commodity);
-    if (!comm) {
+    int item = _inventory.Find(commodity);
+    if (item < 0) {
         //item unknown, fail
         logger.Log(Log::ERROR, "Tried to add unknown item "+commodity);
         return 0;
     }
+    double size = _inventory.GetSize(item);
     int actual_transferred;
-    if (_inventory.GetEmptySpace() >= quantity*comm->size) {
+    if (_inventory.GetEmptySpace() >= quantity*size) {
         actual_transferred = quantity;
     } else {
         if (atomic) {
             actual_transferred = 0;
             logger.Log(Log::DEBUG, "Failed to add "+commodity+std::string(" x") + std::to_string(quantity));
         } else {
-            actual_transferred = std::floor(_inventory.GetEmptySpace()/comm->size);
+            actual_transferred = std::floor(_inventory.GetEmptySpace()/size);
             //overproduced! Drop value of goods accordingly
             int overproduction = quantity - actual_transferred;
-            _inventory.inventory[commodity].original_cost *= std::pow(1.3, -1*overproduction);
+            _inventory.ScaleCost(item, std::pow(1.3, -1*overproduction));
         }
     }
-    _inventory.AddItem(commodity, actual_transferred, unit_price);
+    _inventory.AddItem(item, actual_transferred, unit_price);
     return actual_transferred;
 }
 void PlayerTrader::Shutdown() {
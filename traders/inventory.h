@@ -5,10 +5,9 @@
 #define CPPBAZAARBOT_INVENTORY_H
 #include "../common/commodity.h"
 #include <string>
-#include <map>
+#include <optional>
 #include <vector>
 #include <algorithm>
-#include <unordered_set>
 
 class InventoryItem {
 public:
@@ -31,92 +30,125 @@ public:
     double size = 1;            //default to 1 unit of commodity per unit of inventory space
 };
 
+// What an Inventory holds of one commodity
+struct InventoryEntry {
+    int stored = 0;
+    int ideal_quantity = 0;
+    double original_cost = 0.1;
+    double size = 1;
+};
+
+// Fixed layout: the commodities are those given at construction, and a commodity's id within this inventory is its
+// position in that list. Everything is stored densely by id and used space is kept up to date as items change, so
+// all id-based operations are O(1) and never allocate. Name-based lookups are a short linear scan, so callers on hot
+// paths should Find() a commodity once and hold on to its id.
 class Inventory {
+private:
+    std::vector<std::string> names;
+    std::vector<InventoryEntry> items;
+    double used_space = 0;
+
 public:
     double max_size = 50;
-    std::map<std::string, InventoryItem> inventory;
 
     Inventory() = default;
     Inventory(double max_size, const std::vector<InventoryItem> &starting_inv)
     : max_size(max_size) {
         for (const auto& item : starting_inv) {
-            inventory[item.name] = item;
+            names.push_back(item.name);
+            items.push_back({item.stored, item.ideal_quantity, item.original_cost, item.size});
+            used_space += item.stored*item.size;
         }
     };
 
-    void SetItem(const std::string& name, InventoryItem &new_item) {
-        inventory[name] = new_item;
+    int NumCommodities() const { return (int) items.size(); }
+    const std::string& Name(int id) const { return names[id]; }
+    // -1 if we don't hold this commodity
+    int Find(const std::string& name) const {
+        for (std::size_t id = 0; id < names.size(); id++) {
+            if (names[id] == name) {
+                return (int) id;
+            }
+        }
+        return -1;
+    }
+    const InventoryEntry& Get(int id) const { return items[id]; }
+    // nullptr if we don't hold this commodity
+    const InventoryEntry* GetItem(const std::string& name) const {
+        int id = Find(name);
+        return (id < 0) ? nullptr : &items[id];
     }
 
+    void SetIdeal(int id, int ideal_quantity) {
+        items[id].ideal_quantity = ideal_quantity;
+    }
     bool SetIdeal(const std::string& name, int ideal_quantity) {
-        if (inventory.count(name) != 1) {
+        int id = Find(name);
+        if (id < 0) {
             return false;// no entry found
         }
-        inventory[name].ideal_quantity = ideal_quantity;
+        SetIdeal(id, ideal_quantity);
         return true;
     }
+    void SetCost(int id, double cost) {
+        items[id].original_cost = cost;
+    }
     void SetCost(const std::string& name, double cost) {
-        if (inventory.count(name) != 1) {
+        int id = Find(name);
+        if (id < 0) {
             return;// no entry found
         }
-        inventory[name].original_cost = cost;
+        SetCost(id, cost);
+    }
+    void ScaleCost(int id, double factor) {
+        items[id].original_cost *= factor;
     }
+
     //ignores space constraints - must be checked by trader
-    void AddItem(const std::string& name, int quantity, std::optional<double> unit_price = std::nullopt) {
+    void AddItem(int id, int quantity, std::optional<double> unit_price = std::nullopt) {
+        auto& item = items[id];
         if (unit_price && *unit_price > 0) {
-            if (inventory[name].stored > 0) {
+            if (item.stored > 0) {
                 // update avg orig. cost
-                inventory[name].original_cost = (inventory[name].original_cost * inventory[name].stored + quantity*(*unit_price)) / (inventory[name].stored + quantity);
-
+                item.original_cost = (item.original_cost * item.stored + quantity*(*unit_price)) / (item.stored + quantity);
             } else {
-                inventory[name].original_cost = *unit_price;
+                item.original_cost = *unit_price;
             }
         }
-        inventory[name].stored += quantity;
+        item.stored += quantity;
+        used_space += quantity*item.size;
     }
     //ignores space constraints - must be checked by trader
-    void TakeItem(const std::string& name, int quantity, std::optional<double> unit_price = std::nullopt) {
-        inventory[name].stored -= quantity;
-    }
-
-    int Query(const std::string& name) {
-        if (inventory.count(name) != 1) {
-            return 0; // no entry found
-        }
-        return inventory[name].stored;
+    void TakeItem(int id, int quantity) {
+        items[id].stored -= quantity;
+        used_space -= quantity*items[id].size;
     }
 
-    double QueryCost(const std::string& name) {
-        if (inventory.count(name) != 1) {
-            return 0;; // no entry found
-        }
-        return inventory[name].original_cost;
+    int Query(int id) const { return items[id].stored; }
+    int Query(const std::string& name) const {
+        int id = Find(name);
+        return (id < 0) ? 0 : items[id].stored;
     }
-
-    std::optional<InventoryItem> GetItem(const std::string& name) {
-        if (inventory.count(name) != 1) {
-            return std::nullopt;// no entry found
-        }
-        return inventory[name];
+    double QueryCost(int id) const { return items[id].original_cost; }
+    double QueryCost(const std::string& name) const {
+        int id = Find(name);
+        return (id < 0) ? 0 : items[id].original_cost;
     }
 
-    double GetUsedSpace() {
-        double used = 0;
-        for (const auto &item : inventory) {
-            used += item.second.stored * item.second.size;
-        }
-        return used;
+    double GetUsedSpace() const {
+        return used_space;
     }
-
-    double GetEmptySpace() {
-        return max_size - GetUsedSpace();
+    double GetEmptySpace() const {
+        return max_size - used_space;
     }
 
     std::optional<double> ChangeItem(const std::string& name, int delta, double unit_cost) {
-        if (inventory.count(name) != 1) {
+        int id = Find(name);
+        if (id < 0) {
             return std::nullopt;// no entry found
         }
-        InventoryItem *item_entry = &inventory[name];
+        InventoryEntry *item_entry = &items[id];
+        int previous = item_entry->stored;
         if (unit_cost > 0) {
             if (item_entry->stored <= 0) {
                 item_entry->stored = delta;
@@ -135,36 +167,16 @@ public:
             item_entry->stored = 0;
             item_entry->original_cost = 0;
         }
+        used_space += (item_entry->stored - previous)*item_entry->size;
         return item_entry->original_cost;//return current unit cost
     }
 
-    int Surplus(const std::string& name) {
-        auto stored = Query(name);
-        if (!stored) {
-            return 0;
-        }
-
-        int target = inventory[name].ideal_quantity;
-        if (stored > target) {
-            return stored - target;
-        }
-        return 0;
-    }
-
-    int Shortage(const std::string& name) {
-        auto stored = Query(name);
-
-        int target = inventory[name].ideal_quantity;
-        if (stored < target) {
-            return target - stored;
-        }
-        return 0;
+    int Surplus(int id) const {
+        return std::max(0, items[id].stored - items[id].ideal_quantity);
     }
-    double GetSize(std::string commodity) {
-        if (inventory.count(commodity) != 1) {
-            return 0;// no entry found
-        };
-        return inventory[commodity].size;
+    int Shortage(int id) const {
+        return std::max(0, items[id].ideal_quantity - items[id].stored);
     }
+    double GetSize(int id) const { return items[id].size; }
 };
 #endif//CPPBAZAARBOT_INVENTORY_H
@@ -0,0 +1,115 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_PRICE_MODEL_H
+#define CPPBAZAARBOT_PRICE_MODEL_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../common/ring_buffer.h"
+
+// The range of prices seen over the last `capacity` units traded.
+// A fill is stored as one entry of (price, quantity) rather than one entry per unit, and the oldest entry is trimmed
+// unit by unit as newer ones push it out of the window. The min and max are tracked with monotonic queues, so
+// Record() and Range() are O(1) amortised whatever the fill size, and nothing allocates after construction.
+class TradingRange {
+private:
+    struct Entry {
+        std::uint64_t seq = 0;
+        double price = 0;
+        int quantity = 0;
+    };
+    struct Extreme {
+        std::uint64_t seq = 0;
+        double price = 0;
+    };
+
+    int capacity;
+    int units = 0;
+    std::uint64_t next_seq = 0;
+    RingBuffer<Entry> window;
+    RingBuffer<Extreme> minima;     // prices increasing from front (current min) to back
+    RingBuffer<Extreme> maxima;     // prices decreasing from front (current max) to back
+
+    void PopFront() {
+        auto seq = window.front().seq;
+        if (!minima.empty() && minima.front().seq == seq) {
+            minima.pop_front();
+        }
+        if (!maxima.empty() && maxima.front().seq == seq) {
+            maxima.pop_front();
+        }
+        units -= window.front().quantity;
+        window.pop_front();
+    }
+
+public:
+    // capacity is in units traded. Every entry holds at least one unit, so no queue ever needs more slots than that.
+    explicit TradingRange(int capacity = 50)
+        : capacity(capacity)
+        , window(capacity)
+        , minima(capacity)
+        , maxima(capacity) {};
+
+    bool empty() const { return window.empty(); }
+    int size() const { return units; }
+
+    // (price, quantity) of each entry, oldest first. Recording them in order into an empty range rebuilds this one.
+    std::vector<std::pair<double, int>> Entries() const {
+        std::vector<std::pair<double, int>> entries;
+        entries.reserve(window.size());
+        for (std::size_t i = 0; i < window.size(); i++) {
+            entries.emplace_back(window[i].price, window[i].quantity);
+        }
+        return entries;
+    }
+
+    void Record(double price, int quantity) {
+        if (quantity <= 0 || capacity <= 0) {
+            return;
+        }
+        if (quantity >= capacity) {
+            // pushes out everything we had
+            while (!window.empty()) {
+                PopFront();
+            }
+            quantity = capacity;
+        }
+        while (window.full()) {
+            PopFront();
+        }
+        Entry entry = {next_seq++, price, quantity};
+        while (!minima.empty() && minima.back().price >= price) {
+            minima.pop_back();
+        }
+        minima.push_back({entry.seq, price});
+        while (!maxima.empty() && maxima.back().price <= price) {
+            maxima.pop_back();
+        }
+        maxima.push_back({entry.seq, price});
+        window.push_back(entry);
+
+        // trim the oldest units out of the window
+        units += quantity;
+        while (units - window.front().quantity >= capacity) {
+            PopFront();
+        }
+        if (units > capacity) {
+            window.front().quantity -= units - capacity;
+            units = capacity;
+        }
+    }
+
+    // {min, max} over the window, {0, 0} if nothing has been recorded
+    std::pair<double, double> Range() const {
+        if (window.empty()) {
+            return {0, 0};
+        }
+        return {minima.front().price, maxima.front().price};
+    }
+};
+
+#endif//CPPBAZAARBOT_PRICE_MODEL_H
@@ -0,0 +1,125 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_RECIPES_H
+#define CPPBAZAARBOT_RECIPES_H
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A role's production logic written as a table rather than code.
+//
+// Each tick a trader walks its role's rules in order. A rule fires if all of its conditions hold, running its steps in
+// order; a rule marked last then ends the tick. Conditions only ask whether the trader holds any of a commodity, and
+// always see the inventory as it was at the start of the tick, so earlier steps can't change which later rules fire.
+struct RecipeStep {
+    enum Op {
+        CONSUME,    // use up amount of commodity (or as much as is held)
+        PRODUCE,    // make amount of commodity, priced at the cost of what was consumed since the last production
+        CONVERT,    // consume all held commodity (at most amount, if amount > 0) and produce as many output
+        IDLE_TAX    // pay the trader's idle tax
+    };
+    Op op;
+    std::string commodity;
+    int amount = 1;
+    double chance = 1;          // chance the step happens at all
+    std::string output;         // CONVERT only
+};
+
+struct RecipeCondition {
+    std::string commodity;
+    bool held = true;           // true: holds at least one, false: holds none
+};
+
+struct RecipeRule {
+    std::vector<RecipeCondition> when;
+    std::vector<RecipeStep> steps;
+    bool last = false;
+};
+
+struct Recipe {
+    std::string role;
+    std::vector<RecipeRule> rules;
+};
+
+// A Recipe compiled into flat arrays of integer-indexed tests and instructions.
+// Commodities are referred to by slot, an index into commodities; whoever runs the program binds each slot to its own
+// storage once (an inventory name, a population column), so evaluating it never looks up a commodity by name.
+struct RecipeProgram {
+    struct Test {
+        int slot;
+        bool held;
+    };
+    struct Instruction {
+        RecipeStep::Op op;
+        int slot;
+        int output_slot;        // CONVERT only, otherwise -1
+        int amount;
+        double chance;
+    };
+    struct Rule {
+        int first_test;
+        int num_tests;
+        int first_instruction;
+        int num_instructions;
+        bool last;
+    };
+
+    std::string role;
+    std::vector<std::string> commodities;
+    std::vector<Test> tests;
+    std::vector<Instruction> instructions;
+    std::vector<Rule> rules;
+
+    int Slot(const std::string& commodity) const {
+        for (std::size_t slot = 0; slot < commodities.size(); slot++) {
+            if (commodities[slot] == commodity) {
+                return (int) slot;
+            }
+        }
+        return -1;
+    }
+
+    static std::optional<RecipeProgram> Compile(const Recipe& recipe) {
+        RecipeProgram program;
+        program.role = recipe.role;
+        for (auto& rule : recipe.rules) {
+            Rule compiled = {(int) program.tests.size(), (int) rule.when.size(),
+                             (int) program.instructions.size(), (int) rule.steps.size(), rule.last};
+            for (auto& condition : rule.when) {
+                program.tests.push_back({program.AddSlot(condition.commodity), condition.held});
+            }
+            for (auto& step : rule.steps) {
+                if (step.op != RecipeStep::IDLE_TAX && step.commodity.empty()) {
+                    std::cout << "Error: Recipe for " << recipe.role << " has a step with no commodity" << std::endl;
+                    return std::nullopt;
+                }
+                if (step.op == RecipeStep::CONVERT && step.output.empty()) {
+                    std::cout << "Error: Recipe for " << recipe.role << " converts " << step.commodity << " into nothing" << std::endl;
+                    return std::nullopt;
+                }
+                int slot = (step.op == RecipeStep::IDLE_TAX) ? -1 : program.AddSlot(step.commodity);
+                int output_slot = (step.op == RecipeStep::CONVERT) ? program.AddSlot(step.output) : -1;
+                program.instructions.push_back({step.op, slot, output_slot, step.amount, step.chance});
+            }
+            program.rules.push_back(compiled);
+        }
+        return program;
+    }
+
+private:
+    int AddSlot(const std::string& commodity) {
+        int slot = Slot(commodity);
+        if (slot < 0) {
+            commodities.push_back(commodity);
+            slot = (int) commodities.size() - 1;
+        }
+        return slot;
+    }
+};
+
+#endif//CPPBAZAARBOT_RECIPES_H
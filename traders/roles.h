@@ -6,138 +6,77 @@
 #define CPPBAZAARBOT_ROLES_H
 
 #include "AI_trader.h"
+#include "recipes.h"
 
 class EmptyRole : public Role {
     void TickRole(AITrader& trader) override {};
 };
 
-class RoleFarmer : public Role {
-public:
-    RoleFarmer(int min_cost) : Role("fertilizer", min_cost) {};
-    void TickRole(AITrader& trader) override {
-        bool has_wood = (0 < trader.Query("wood"));
-        bool has_tools = (0 < trader.Query("tools"));
-        bool has_fertilizer = (0 < trader.Query("fertilizer"));
-
-        if (!has_fertilizer) {
-            LoseMoney(trader, trader.GetIdleTax());
-            return;
-        }
-        Consume(trader, "fertilizer", 1);
-        if (has_tools && has_wood) {
-            // 10% chance tools break
-            Consume(trader, "tools", 1, 0.1);
-            Consume(trader, "wood", 1);
-            Produce(trader, "food", 6);
-        } else if (has_wood){
-            Consume(trader, "wood", 1);
-            Produce(trader, "food", 3);
-        } else {
-            Produce(trader, "food", 1);
+// Runs a compiled recipe (see recipes.h) for a single trader. The program is shared by every trader of the role; its
+// slots are bound to the trader's inventory ids on the first tick, so a RecipeRole must only ever drive one trader.
+class RecipeRole : public Role {
+private:
+    std::shared_ptr<const RecipeProgram> program;
+    std::vector<int> items; //per program slot, the trader's inventory id for it
+    std::vector<bool> held; //per program slot, as of the start of this tick
+
+    void Run(AITrader& trader, const RecipeProgram::Instruction& instruction) {
+        switch (instruction.op) {
+            case RecipeStep::IDLE_TAX:
+                if (Random(trader, instruction.chance)) {
+                    LoseMoney(trader, trader.GetIdleTax());
+                }
+                return;
+            case RecipeStep::CONSUME:
+                Consume(trader, items[instruction.slot], instruction.amount, instruction.chance);
+                return;
+            case RecipeStep::PRODUCE:
+                Produce(trader, items[instruction.slot], instruction.amount, instruction.chance);
+                return;
+            case RecipeStep::CONVERT:
+                if (Random(trader, instruction.chance)) {
+                    int quantity = trader.Query(items[instruction.slot]);
+                    if (instruction.amount > 0) {
+                        quantity = std::min(quantity, instruction.amount);
+                    }
+                    Consume(trader, items[instruction.slot], quantity);
+                    Produce(trader, items[instruction.output_slot], quantity);
+                }
+                return;
         }
     }
-};
 
-class RoleWoodcutter : public Role {
 public:
-    RoleWoodcutter(int min_cost) : Role("food", min_cost) {};
-    void TickRole(AITrader& trader) override {
-        bool has_food = (0 < trader.Query("food"));
-        bool has_tools = (0 < trader.Query("tools"));
-
-        if (!has_food) {
-            LoseMoney(trader, trader.GetIdleTax());//$2 idleness fine
-            return;
-        }
-
-        if (has_tools) {
-            // 10% chance tools break
-            Consume(trader, "tools", 1, 0.1);
-            Consume(trader, "food", 1);
-            Produce(trader, "wood", 2);
-        } else {
-            Consume(trader, "food", 1);
-            Produce(trader, "wood", 1);
-        }
-    }
-};
+    RecipeRole(std::shared_ptr<const RecipeProgram> recipe, double min_cost, double fulfillment_floor = 0)
+        : Role("none", min_cost, fulfillment_floor)
+        , program(std::move(recipe))
+        , held(program->commodities.size()) {};
 
-class RoleComposter : public Role {
-public:
-    RoleComposter(int min_cost) : Role("food", min_cost) {};
     void TickRole(AITrader& trader) override {
-        bool has_food = (0 < trader.Query("food"));
-        if (!has_food) {
-            LoseMoney(trader, trader.GetIdleTax());
-            return;
+        if (items.empty()) {
+            for (auto& commodity : program->commodities) {
+                items.push_back(trader.FindItem(commodity));
+            }
         }
-        Consume(trader, "food", 1);
-        Produce(trader, "fertilizer", 1, 0.5);
-    }
-};
-
-class RoleBlacksmith : public Role {
-public:
-    RoleBlacksmith(int min_cost) : Role("food", min_cost) {};
-    void TickRole(AITrader& trader) override {
-        bool has_food = (0 < trader.Query("food"));
-        int amount_metal = trader.Query("metal");
-
-        if (!has_food) {
-            LoseMoney(trader, trader.GetIdleTax());
+        for (std::size_t slot = 0; slot < held.size(); slot++) {
+            held[slot] = (0 < trader.Query(items[slot]));
         }
-
-        Consume(trader, "food", 1);
-
-        if (amount_metal > 0) {
-            Consume(trader, "metal", amount_metal);
-            Produce(trader, "tools", amount_metal);
-        }
-    };
-};
-
-class RoleMiner : public Role {
-public:
-    RoleMiner(int min_cost) : Role("food", min_cost) {};
-    void TickRole(AITrader& trader) override {
-        bool has_food = (0 < trader.Query("food"));
-        bool has_tools = (0 < trader.Query("tools"));
-
-        if (!has_food) {
-            LoseMoney(trader, trader.GetIdleTax());
+        for (auto& rule : program->rules) {
+            bool fires = true;
+            for (int t = rule.first_test; t < rule.first_test + rule.num_tests; t++) {
+                fires = fires && (held[program->tests[t].slot] == program->tests[t].held);
+            }
+            if (!fires) {
+                continue;
+            }
+            for (int i = rule.first_instruction; i < rule.first_instruction + rule.num_instructions; i++) {
+                Run(trader, program->instructions[i]);
+            }
+            if (rule.last) {
+                return;
+            }
         }
-        Consume(trader, "food", 1);
-        if (has_tools) {
-            Consume(trader, "tools", 1, 0.1);
-            Produce(trader, "ore", 4);
-        } else {
-            Produce(trader, "ore", 2);
-        }
-    };
+    }
 };
 
-class RoleRefiner : public Role {
-public:
-    RoleRefiner(int min_cost) : Role("food", min_cost) {};
-    void TickRole(AITrader& trader) override {
-        bool has_food = (0 < trader.Query("food"));
-        bool has_tools = (0 < trader.Query("tools"));
-        int amount_ore = trader.Query("ore");
-        if (!has_food) {
-            LoseMoney(trader, trader.GetIdleTax());
-        }
-        Consume(trader, "food", 1);
-
-        if (has_tools) {
-            Consume(trader, "tools", 1, 0.1);
-            Consume(trader, "ore", amount_ore);
-            Produce(trader, "metal", amount_ore);
-        } else {
-            //convert up to 2 ore into metal if no tools
-            int quantity = std::min(amount_ore, 2);
-            Consume(trader, "ore", quantity);
-            Produce(trader, "metal", quantity);
-        }
-    };
-};
 #endif//CPPBAZAARBOT_ROLES_H
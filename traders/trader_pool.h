@@ -0,0 +1,211 @@
+//
+// Created by henry on 18/10/2026.
+//
+
+#ifndef CPPBAZAARBOT_TRADER_POOL_H
+#define CPPBAZAARBOT_TRADER_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AI_trader.h"
+
+// Everything needed to bring up a new AITrader, bar the auction house and tick rate
+struct TraderSpec {
+    int id;
+    std::shared_ptr<Role> logic;
+    std::string name;
+    double starting_money;
+    double inv_capacity;
+    std::vector<InventoryItem> inventory;
+};
+
+// Keeps AITraders alive after they die so they can be respawned in place.
+// Each slot is a trader plus the thread that ticks it. When a trader dies its slot waits until the auction house has
+// deregistered it, then Spawn() resets it as a brand new trader (new id, role, money and inventory) and its threads
+// carry on with it. A respawn then costs no thread creation and no new trader, and the pool only ever grows to the
+// most traders alive (or dead but not yet deregistered) at once, however many have come and gone.
+class TraderPool {
+private:
+    struct Slot {
+        std::shared_ptr<AITrader> trader;
+        std::thread thread;
+        bool running = false;               // a live trader is assigned; guarded by mutex
+        std::condition_variable wake;
+    };
+
+    std::shared_ptr<AuctionHouse> auction_house;
+    int tick_time_ms;
+    Log::LogLevel verbosity;
+
+    std::mutex mutex;
+    bool active = true;
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<Slot*> dead;                // oldest death first
+    int num_recycled = 0;
+
+    void SlotLoop(Slot* slot) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            slot->wake.wait(lock, [this, slot] { return slot->running || !active; });
+            if (!active) {
+                return;
+            }
+            lock.unlock();
+            slot->trader->Tick();           // until the trader dies
+            lock.lock();
+            slot->running = false;
+            dead.push_back(slot);
+        }
+    }
+
+    // Requires mutex. A dead slot the auction house no longer knows about, or nullptr.
+    Slot* TakeDeadSlot() {
+        for (auto it = dead.begin(); it != dead.end(); it++) {
+            if (!auction_house->IsRegistered((*it)->trader->id)) {
+                Slot* slot = *it;
+                dead.erase(it);
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Requires mutex, which is dropped while a recycled trader is reset. A slot holding a new trader built to spec,
+    // not yet registered or running.
+    Slot* Acquire(std::unique_lock<std::mutex>& lock, const TraderSpec& spec) {
+        Slot* slot = TakeDeadSlot();
+        if (slot) {
+            // Its tick thread is idle until running is set, so only the message thread needs stopping
+            lock.unlock();
+            if (slot->trader->Park()) {
+                slot->trader->Reset(spec.id, spec.logic, spec.name, spec.starting_money, spec.inv_capacity, spec.inventory);
+                slot->trader->Unpark();
+                lock.lock();
+                num_recycled++;
+                return slot;
+            }
+            // The message thread has gone, so the slot is no use to anyone. Left out of dead for good.
+            lock.lock();
+        }
+        slots.push_back(std::make_unique<Slot>());
+        slot = slots.back().get();
+        slot->trader = std::make_shared<AITrader>(spec.id, auction_house, spec.logic, spec.name, spec.starting_money, spec.inv_capacity, spec.inventory, tick_time_ms, verbosity);
+        slot->thread = std::thread(&TraderPool::SlotLoop, this, slot);
+        return slot;
+    }
+
+    // Requires mutex
+    void Start(Slot* slot) {
+        slot->running = true;
+        slot->wake.notify_one();
+    }
+
+public:
+    TraderPool(std::shared_ptr<AuctionHouse> auction_house, int tick_time_ms, Log::LogLevel verbosity)
+        : auction_house(std::move(auction_house))
+        , tick_time_ms(tick_time_ms)
+        , verbosity(verbosity) {};
+
+    TraderPool(const TraderPool&) = delete;
+    TraderPool& operator=(const TraderPool&) = delete;
+
+    ~TraderPool() {
+        Shutdown();
+    }
+
+    // Same as CreateAndRegister, except that the trader's threads are taken care of: it's already ticking on return
+    std::shared_ptr<AITrader> Spawn(const TraderSpec& spec) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!active) {
+            return std::shared_ptr<AITrader>();
+        }
+        Slot* slot = Acquire(lock, spec);
+        auto& trader = slot->trader;
+        trader->SendMessage(*Message(spec.id).AddRegisterRequest(std::move(RegisterRequest(trader->id, trader))), auction_house->id);
+        Start(slot);
+        return trader;
+    }
+
+    // Spawns a cohort, registered with the auction house in bulk (see AuctionHouse::RegisterTraders). If given,
+    // prepare(i, trader) is called on the trader for specs[i] before it is registered or starts ticking.
+    std::vector<std::shared_ptr<AITrader>> SpawnBatch(const std::vector<TraderSpec>& specs,
+                                                      const std::function<void(std::size_t, AITrader&)>& prepare = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::vector<std::shared_ptr<AITrader>> traders;
+        if (!active) {
+            return traders;
+        }
+        std::vector<Slot*> acquired;
+        acquired.reserve(specs.size());
+        traders.reserve(specs.size());
+        slots.reserve(slots.size() + specs.size());
+        for (auto& spec : specs) {
+            acquired.push_back(Acquire(lock, spec));
+            traders.push_back(acquired.back()->trader);
+            if (prepare) {
+                prepare(traders.size() - 1, *traders.back());
+            }
+        }
+        auction_house->RegisterTraders(traders);
+        for (auto* slot : acquired) {
+            Start(slot);
+        }
+        return traders;
+    }
+
+    // Stops every trader's tick loop and joins the slot threads. The traders themselves (and their message threads)
+    // go when the last reference to them does.
+    void Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!active) {
+                return;
+            }
+            active = false;
+            for (auto& slot : slots) {
+                slot->trader->destroyed = true;
+                slot->wake.notify_one();
+            }
+        }
+        for (auto& slot : slots) {
+            if (slot->thread.joinable()) {
+                slot->thread.join();
+            }
+        }
+    }
+
+    // Every trader the pool holds, dead or alive
+    std::vector<std::shared_ptr<AITrader>> Traders() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::shared_ptr<AITrader>> traders;
+        for (auto& slot : slots) {
+            traders.push_back(slot->trader);
+        }
+        return traders;
+    }
+
+    int NumSlots() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (int) slots.size();
+    }
+    // Traders alive and ticking. Unlike the auction house's count, this includes ones whose registration is pending.
+    int NumAlive() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int num_alive = 0;
+        for (auto& slot : slots) {
+            num_alive += (slot->running && !slot->trader->destroyed);
+        }
+        return num_alive;
+    }
+    int NumRecycled() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return num_recycled;
+    }
+};
+
+#endif//CPPBAZAARBOT_TRADER_POOL_H